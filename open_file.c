@@ -26,15 +26,31 @@
 #	include <windows.h>
 #	include <sys/types.h>
 #	include <dirent.h>
+#	include <fcntl.h>
+#	include <io.h>
+#	include <glib/gstdio.h>
 #	define PATH_SEPARATOR '\\'
 #	define DEFAULT_PATTERN "*.*"
 #else
+#	include <fcntl.h>
 #	include <fnmatch.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
 #	include <wordexp.h>
 #	define DEFAULT_PATTERN "*"
 #	define PATH_SEPARATOR '/'
 #endif
 
+#ifdef __linux__
+#	include <sys/resource.h>
+#	include <sys/syscall.h>
+#	include <sys/vfs.h>
+#	include <unistd.h>
+#	define IOPRIO_CLASS_IDLE 3
+#	define IOPRIO_CLASS_SHIFT 13
+#	define IOPRIO_WHO_PROCESS 1
+#endif
+
 
 #define D(x) /*x*/
 
@@ -52,6 +68,29 @@ static const int   WINDOW_HEIGHT = 500;
 static const char *LOCATIONS = "locations";
 static const char *PATHS = "paths";
 static const char *PATTERNS = "patterns";
+static const guint CONTENT_SEARCH_DELAY = 150;      /* ms without typing before a content search starts */
+static const guint CONTENT_DRAIN_INTERVAL = 50;     /* ms between moving content matches into the list */
+static const gint  CONTENT_MAX_MATCHES = 10000;
+static const gsize CONTENT_BINARY_PROBE = 8192;     /* files with a NUL byte in this prefix are binary */
+static const gsize CONTENT_MAX_TEXT = 256;          /* longest part of a matching line that is shown */
+static const gsize CONTENT_READ_SIZE = 256 * 1024;  /* bytes read at a time by a content search worker */
+static const guint INDEX_BLOCK_SIZE = 32;           /* index entries decodable from one block header */
+static const gint64 LOCATION_SCAN_TIME = 60 * G_USEC_PER_SEC;
+static const gint64 SLOW_LOCATION_SCAN_TIME = 300 * G_USEC_PER_SEC;
+static const gint64 LOCATION_GRACE_TIME = 10 * G_USEC_PER_SEC;  /* before giving up on a blocked location */
+static const gint64 CANCEL_GRACE_TIME = 2 * G_USEC_PER_SEC;
+static const guint LOCATION_MAX_ENTRIES = 5000000;
+static const char *READDIR_DELAY_VARIABLE = "OPEN_FILE_READDIR_DELAY";  /* ms, to test slow locations */
+static const guint FILTER_CHUNK_BLOCKS = 512;       /* index blocks matched by one task, a few hundred KB */
+static const gsize QUERY_CACHE_BUDGET = 16 * 1024 * 1024;   /* bytes of remembered query results */
+static const char *INDEX_CACHE_FILE_NAME = "index.cache";
+static const char *INDEX_CACHE_MAGIC = "open-file index 1\n";
+static const gint64 RACY_DIRECTORY_TIME = 2 * G_USEC_PER_SEC;  /* directories changed this recently are read again */
+static const guint FILE_INFO_BATCH = 256;           /* files looked up by one task */
+static const guint FILE_INFO_DRAIN_INTERVAL = 50;   /* ms between showing looked up file information */
+static const gint  FILE_INFO_SORT_LIMIT = 20000;    /* most listed files looked up to sort by them */
+static const guint FILE_LIST_MAX_ROWS = 10000;      /* files listed at most, the first in the sort order */
+static const guint RANK_RANGES = 65536;             /* ranges of ranks counted to find the first listed files */
 
 
 /**********************************************************************/
@@ -68,13 +107,34 @@ enum
 
 
 /**********************************************************************/
+/* The file list only stores index ids, the columns are rendered from
+ * the index */
 enum
 {
-	COLUMN_OPEN_FILE_SHORT_NAME = 0,
-	COLUMN_OPEN_FILE_PATH = 1,
+	COLUMN_OPEN_FILE_ID = 0,
 	OPEN_FILE_COLUMN_COUNT
 };
 
+/**********************************************************************/
+typedef enum
+{
+	SORT_BY_NAME = 0,
+	SORT_BY_PATH,
+	SORT_BY_SIZE,
+	SORT_BY_MODIFIED,
+	SORT_KEY_COUNT
+} SortKey;
+
+/**********************************************************************/
+enum
+{
+	COLUMN_CONTENT_SHORT_NAME = 0,
+	COLUMN_CONTENT_PATH = 1,
+	COLUMN_CONTENT_LINE = 2,
+	COLUMN_CONTENT_TEXT = 3,
+	CONTENT_COLUMN_COUNT
+};
+
 /**********************************************************************/
 typedef enum
 {
@@ -91,11 +151,34 @@ struct PLUGIN_DATA
 	GtkWidget           *tree_view;
 	GtkTreeSelection    *selection;
 	GtkTreeModel        *model;
-	GtkTreeModel        *filter;
-	GtkTreeModel        *sorted;
 	const gchar         *text_value;
+	struct QueryResult  *query_result;  /* files matching text_value, NULL if all do */
+	SortKey              sort_key;
+	GtkSortType          sort_order;
+	gchar               *row_path;      /* of the row rendered last */
+	gsize                row_name_len;
+	guint                row_id;
+	guint                row_serial;    /* of the index row_id belongs to */
+	GtkTreeViewColumn   *name_column;
+	GtkTreeViewColumn   *path_column;
+	GtkTreeViewColumn   *size_column;
+	GtkTreeViewColumn   *modified_column;
+	guint                file_info_idle_id;
 	GtkWidget           *cancel_button;
 	GtkWidget           *open_button;
+	GtkWidget           *content_check;
+	GtkWidget           *regex_check;
+	GtkWidget           *details_check;
+	GtkWidget           *file_list_window;
+	GtkWidget           *content_list_window;
+	GtkWidget           *content_view;
+	GtkWidget           *status_label;
+	GtkListStore        *content_store;
+	GPtrArray           *content_files;
+	struct ContentSearch *content_search;
+	gint                 content_rows;
+	guint                content_delay_id;
+	guint                content_drain_id;
 } PLUGIN_DATA;
 
 /**********************************************************************/
@@ -105,10 +188,305 @@ typedef struct
 	gchar* pattern;
 } Location;
 
+/**********************************************************************/
+typedef void (*WorkerFunc)(gpointer data);
+
+typedef struct
+{
+	WorkerFunc func;
+	gpointer   data;
+} WorkerTask;
+
+/**********************************************************************/
+/* A content search over the indexed files. The dialog and every worker
+ * searching for it hold a reference; workers claim files one at a time
+ * through next_file and stop as soon as cancelled is set. */
+typedef struct ContentSearch
+{
+	volatile gint  ref_count;
+	volatile gint  cancelled;
+	volatile gint  next_file;
+	volatile gint  running;
+	volatile gint  match_count;
+	GPtrArray     *files;       /* full path of every indexed file */
+	gchar         *needle;      /* literal every matching line contains, may be empty */
+	gsize          needle_len;
+	gboolean       ignore_case;
+	GRegex        *regex;       /* verifies candidate lines, NULL for plain text */
+	GAsyncQueue   *results;     /* ContentMatch */
+} ContentSearch;
+
+typedef struct
+{
+	guint  file;
+	gint   line;
+	gchar *text;
+} ContentMatch;
+
+static GThreadPool *worker_pool = NULL;
+
+/**********************************************************************/
+/* A directory read by the scan. If its modification and change times
+ * are the same at the next scan, it still has the same entries. */
+typedef struct
+{
+	gchar  *path;
+	gint64  mtime;   /* ns, -1 if it may have changed while it was read */
+	gint64  ctime;
+} DirectoryRecord;
+
+/* Size and modification time of an index entry, looked up when the
+ * file list shows or sorts by them */
+typedef struct
+{
+	gint64   size;       /* -1 if the file could not be looked up */
+	gint64   mtime;      /* seconds */
+	guint    session;    /* file_info_session of the lookup, 0 if never */
+	gboolean pending;
+} FileInfo;
+
+/* The files of an index with the same extension */
+typedef struct
+{
+	gchar *extension;    /* "" for files without one */
+	guint  start;        /* of the ids in extension_ids */
+	guint  count;
+} ExtensionBucket;
+
+/* All files found in the configured locations, as full paths sorted in
+ * byte order. The paths are front coded: each entry only stores how many
+ * bytes it shares with the previous path and the bytes that follow. The
+ * first entry of every block of INDEX_BLOCK_SIZE entries shares nothing,
+ * so decoding can start at any block. An index is built by the
+ * background scan and never changed once it has been published, except
+ * for infos which only the main thread uses. */
+typedef struct
+{
+	guint    count;
+	guint    block_count;
+	guint32 *blocks;     /* offset in data of the first entry of each block */
+	guint8  *data;
+	gsize    size;
+	guint32 *name_ranks; /* position of each entry sorted by file name */
+	guint32 *path_ranks; /* position of each entry sorted by directory */
+	guint32 *extension_ids;       /* ids grouped by extension, sorted within a bucket */
+	ExtensionBucket *extensions;  /* sorted by extension */
+	guint    extension_count;
+	DirectoryRecord *directories; /* sorted by path, of completely scanned locations */
+	guint    directory_count;
+	FileInfo *infos;     /* NULL until a file is looked up */
+	guint    serial;     /* tells indexes apart, an address may be reused */
+} FileIndex;
+
+/* Decodes index entries in order, starting at a block */
+typedef struct
+{
+	const FileIndex *index;
+	guint            id;        /* of the entry in path */
+	guint            next_id;
+	gsize            offset;    /* of the next entry in the index data */
+	GString         *path;
+	gsize            name_len;  /* of the file name at the end of path */
+} IndexCursor;
+
+/* The first rows of a query result in the order of the name or path
+ * column, sorted when first listed and kept for the index they were
+ * sorted with */
+typedef struct SortedRows
+{
+	guint32 *ids[SORT_BY_PATH + 1][2];   /* by sort key and order, NULL if not sorted yet */
+	guint    count[SORT_BY_PATH + 1][2];
+	guint    generation;                 /* file_index_generation when sorted */
+} SortedRows;
+
+/* The ids of the index entries whose file name matches a query. Few
+ * matches are kept as a sorted array of ids, more as one bit per entry,
+ * whichever is smaller. */
+typedef struct QueryResult
+{
+	gint       ref_count;
+	guint      count;
+	guint32   *ids;         /* NULL if bits is used */
+	guint8    *bits;
+	gsize      size;        /* bytes used by ids or bits */
+	SortedRows rows;
+} QueryResult;
+
+/* The rows of the file list, the ids of the listed files in the order
+ * they are shown. It takes the ids as they are, so replacing the list
+ * does not insert every row like a GtkListStore. */
+typedef struct
+{
+	GObject  parent;
+	guint32 *ids;
+	guint    count;
+	gint     stamp;
+} FileListModel;
+
+typedef struct
+{
+	GObjectClass parent_class;
+} FileListModelClass;
+
+/* Index entries looked up together by a worker */
+typedef struct
+{
+	guint     serial;      /* of the index the ids belong to */
+	guint     session;
+	gint      load;        /* plugin_load when it was pushed */
+	guint     count;
+	guint32  *ids;
+	gchar   **paths;
+	FileInfo *infos;
+} FileInfoTask;
+
+/* Matching a query against many candidates, split into chunks of the
+ * files of FILTER_CHUNK_BLOCKS blocks that threads claim through next_chunk. The
+ * main thread waits until pending drops to zero, workers starting after
+ * that only drop their reference. */
+typedef struct
+{
+	volatile gint    ref_count;
+	volatile gint    next_chunk;
+	volatile gint    pending;      /* chunks not matched yet */
+	const FileIndex *index;
+	const gchar     *words;
+	const guint32   *candidates;   /* ids to match, NULL for all */
+	guint            total;        /* number of candidates */
+	guint            chunk_count;
+	GArray         **chunks;       /* ids matching in each chunk */
+	GMutex           mutex;
+	GCond            done;
+} FilterJob;
+
+/* A recent query result, kept until the memory budget is used up */
+typedef struct
+{
+	gchar       *query;   /* normalised */
+	QueryResult *result;
+	GList       *link;    /* in query_cache_order */
+} CachedQuery;
+
+/* A file found by the scan, before it is added to the index */
+typedef struct
+{
+	gchar *path;
+	gsize  name_len;
+} ScanFile;
+
+/**********************************************************************/
+typedef enum
+{
+	SCAN_RUNNING,
+	SCAN_DONE,
+	SCAN_KEPT,             /* slow file system, only rescanned in the background */
+	SCAN_TIMED_OUT,        /* stopped at the time budget, partial results */
+	SCAN_TOO_MANY,         /* stopped at the entry budget, partial results */
+	SCAN_NOT_RESPONDING,   /* blocked in the file system, last results kept */
+	SCAN_FAILED            /* the location could not be read */
+} ScanStatus;
+
+typedef struct
+{
+	gchar       *path;
+	const gchar *fs_type;  /* name of a slow file system, or NULL */
+	ScanStatus   status;
+	guint        files;
+} LocationStatus;
+
+enum
+{
+	LOCATION_RUNNING = 0,
+	LOCATION_FINISHED,
+	LOCATION_ABANDONED
+};
+
+/**********************************************************************/
+/* The scan of one location, on a thread of its own so a slow location
+ * does not hold up the others. Once the index scan has abandoned it
+ * the thread frees it, otherwise the index scan does. */
+typedef struct
+{
+	volatile gint  state;
+	volatile gint  cancelled;
+	volatile gint  slow;
+	const gchar   *fs_type;
+	Location      *location;      /* path already expanded */
+	gboolean       skip_slow;
+	gulong         readdir_delay;
+	GThread       *thread;
+	GAsyncQueue   *finished;      /* of the index scan */
+	GArray        *files;         /* ScanFile */
+	GArray        *directories;   /* DirectoryRecord, read by this scan */
+	GArray        *old_files;     /* ScanFile of the last scan, sorted by directory */
+	GArray        *old_directories; /* DirectoryRecord of the last scan, sorted by path */
+	ScanStatus     status;
+	guint          entries;
+	gint64         started;
+	gint64         deadline;
+} LocationScan;
+
+/**********************************************************************/
+typedef struct
+{
+	GSList          *locations;   /* Location, paths already expanded */
+	const FileIndex *previous;    /* the index this scan replaces, may be NULL */
+	gboolean         refresh;     /* slow file systems are not rescanned */
+	gulong           readdir_delay;
+	GAsyncQueue     *finished;    /* LocationScan, or the scan itself to wake it up */
+	GAsyncQueue     *updates;     /* IndexUpdate */
+	gboolean         abandoned;   /* threads were left blocked in a file system */
+	volatile gint    cancelled;
+	gchar           *cache_file;
+	gboolean         cache_current; /* the cache file has the last published index */
+} IndexScan;
+
+/* Published by the index scan every time a location is done */
+typedef struct
+{
+	FileIndex *index;     /* NULL if unchanged */
+	GArray    *statuses;  /* LocationStatus */
+	gboolean   last;
+} IndexUpdate;
+
+typedef enum
+{
+	RESCAN_REFRESH,   /* keep a running scan, do not rescan slow file systems */
+	RESCAN_FULL,      /* rescan everything after a running scan */
+	RESCAN_RESTART    /* cancel a running scan, the configuration changed */
+} RescanMode;
+
+static FileIndex *file_index = NULL;
+static gint file_index_serial = 0;             /* of the last index built or loaded */
+static guint file_index_generation = 0;        /* changed every time file_index is replaced */
+static gboolean file_index_saved = FALSE;       /* the cache file has file_index */
+static GHashTable *query_cache = NULL;         /* normalised query -> CachedQuery */
+static GQueue query_cache_order = G_QUEUE_INIT; /* CachedQuery, most recently used first */
+static gsize query_cache_size = 0;
+static guint query_cache_generation = 0;
+static GArray *location_selection = NULL;      /* ids selected by the location patterns, NULL for all */
+static SortedRows all_files_rows;              /* of the NULL result, when every file matches */
+static GSList *file_locations = NULL;          /* Location, paths expanded */
+static GArray *location_statuses = NULL;
+static GMutex hung_locations_mutex;
+static GHashTable *hung_locations = NULL;      /* path -> abandoned scan threads of it still running */
+static IndexScan *index_scan = NULL;
+static GThread *index_thread = NULL;
+static gboolean index_rescan_pending = FALSE;
+static struct PLUGIN_DATA *open_dialog = NULL;
+static guint file_info_session = 0;            /* changed every time the dialog is opened */
+static FileIndex *file_info_source = NULL;     /* earlier index with file information not carried over yet */
+static GAsyncQueue *file_info_results = NULL;  /* FileInfoTask looked up by the workers */
+static guint file_info_tasks = 0;              /* pushed to the workers and not shown yet */
+static guint file_info_drain_id = 0;
+static volatile gint plugin_load = 0;          /* counted up at unload, lookups pushed before are dropped */
+static gboolean show_file_details = FALSE;
+
 
 static GtkWidget *configure(GeanyPlugin *plugin, GtkDialog *parent, gpointer pdata);
 static GSList* load_configuration(void);
 static void clear_configuration(GSList* locations);
+static void index_rescan(RescanMode mode);
 
 /**********************************************************************/
 D(static void log_debug(const gchar* s, ...)
@@ -121,202 +499,3886 @@ D(static void log_debug(const gchar* s, ...)
 	va_end(l);
 })
 
-#if defined (WIN32)
+/**********************************************************************/
+static void run_worker_task(gpointer data, G_GNUC_UNUSED gpointer user_data)
+{
+	WorkerTask *task = data;
+
+	task->func(task->data);
+	g_free(task);
+}
+
 
 /**********************************************************************/
-static void list_files_in_dir(GtkListStore *store, const char *path, const char *pattern)
+static guint worker_count(void)
 {
-	WIN32_FIND_DATA ff;
+	return MAX(g_get_num_processors(), 1);
+}
+
+
+/**********************************************************************/
+static void worker_pool_push(WorkerFunc func, gpointer data)
+{
+	WorkerTask *task = g_malloc(sizeof(WorkerTask));
+	task->func = func;
+	task->data = data;
 
-	D(log_debug("%s:%s - path: %s, pattern: %s", __FILE__, __FUNCTION__, path, pattern));
+	if(worker_pool == NULL)
+		worker_pool = g_thread_pool_new(run_worker_task, NULL, worker_count(), FALSE, NULL);
+	g_thread_pool_push(worker_pool, task, NULL);
+}
 
-	gchar *full_path = g_build_filename(path, pattern, NULL);
 
-	HANDLE findhandle = FindFirstFile(full_path, &ff);
-	if(findhandle != INVALID_HANDLE_VALUE)
+/**********************************************************************/
+static void put_varint(GByteArray *data, guint64 value)
+{
+	guint8 byte;
+
+	while(value >= 0x80)
 	{
-		do
-		{
-			if(!(ff.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
-			{
-				GtkTreeIter tree_iter;
-				gtk_list_store_append(store, &tree_iter);
-				gchar *file_name = g_locale_to_utf8(ff.cFileName, -1, NULL, NULL, NULL);
-				gchar *path_name = g_locale_to_utf8(path, -1, NULL, NULL, NULL);
-				gtk_list_store_set(store, &tree_iter, COLUMN_OPEN_FILE_SHORT_NAME, file_name, -1);
-				gtk_list_store_set(store, &tree_iter, COLUMN_OPEN_FILE_PATH, path_name, -1);
-				g_free(file_name);
-				g_free(path_name);
-			}
+		byte = (value & 0x7f) | 0x80;
+		g_byte_array_append(data, &byte, 1);
+		value >>= 7;
+	}
+	byte = value;
+	g_byte_array_append(data, &byte, 1);
+}
 
-		}while(FindNextFile(findhandle, &ff));
 
-		FindClose(findhandle);
+/**********************************************************************/
+static gsize get_varint(const guint8 **data)
+{
+	gsize value = 0;
+	guint shift = 0;
+
+	while(**data & 0x80)
+	{
+		value |= (gsize)(**data & 0x7f) << shift;
+		shift += 7;
+		(*data)++;
 	}
-	g_free(full_path);
+	value |= (gsize)**data << shift;
+	(*data)++;
+
+	return value;
 }
 
+
 /**********************************************************************/
-static void list_directory(GtkListStore *store, const char *path, const char *pattern)
+static gint compare_scan_files(gconstpointer a, gconstpointer b)
 {
-	WIN32_FIND_DATA ff;
+	return strcmp(((const ScanFile*)a)->path, ((const ScanFile*)b)->path);
+}
 
-	D(log_debug("%s:%s", __FILE__, __FUNCTION__));
 
-	list_files_in_dir(store, path, pattern);
+/**********************************************************************/
+/* Builds an index of the scanned files. Files found in more than one
+ * location are only added once. */
+static FileIndex *file_index_build(GArray *files)
+{
+	FileIndex *index = g_malloc0(sizeof(FileIndex));
+	GByteArray *data = g_byte_array_new();
 
-	gchar *full_path = g_build_filename(path, "*.*", NULL);
-	HANDLE findhandle = FindFirstFile(full_path, &ff);
-	if(findhandle != INVALID_HANDLE_VALUE)
+	index->serial = g_atomic_int_add(&file_index_serial, 1) + 1;
+	const gchar *previous = NULL;
+	guint i;
+
+	g_array_sort(files, compare_scan_files);
+	index->blocks = g_malloc(sizeof(guint32) * (files->len / INDEX_BLOCK_SIZE + 1));
+
+	for(i = 0; i < files->len; ++i)
 	{
-		do
-		{
-			if((ff.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && g_strcmp0(ff.cFileName, ".") != 0 && g_strcmp0(ff.cFileName, "..") != 0)
-			{
-				gchar *new_path = g_build_filename(path, ff.cFileName, NULL);
-				list_directory(store, new_path, pattern);
-				g_free(new_path);
-			}
+		const ScanFile *file = &g_array_index(files, ScanFile, i);
+		gsize length = strlen(file->path);
+		gsize prefix = 0;
 
-		}while(FindNextFile(findhandle, &ff));
+		if(previous != NULL && strcmp(previous, file->path) == 0)
+			continue;
 
-		FindClose(findhandle);
+		if(index->count % INDEX_BLOCK_SIZE == 0)
+			index->blocks[index->block_count++] = data->len;
+		else
+			while(previous[prefix] != '\0' && previous[prefix] == file->path[prefix])
+				prefix++;
+
+		put_varint(data, prefix);
+		put_varint(data, length - prefix);
+		put_varint(data, file->name_len);
+		g_byte_array_append(data, (const guint8*)file->path + prefix, length - prefix);
+
+		previous = file->path;
+		index->count++;
 	}
 
-	g_free(full_path);
+	index->size = data->len;
+	index->data = g_realloc(g_byte_array_free(data, FALSE), MAX(index->size, 1));
+
+	return index;
 }
 
-#else
 
 /**********************************************************************/
-static void list_directory(GtkListStore *store, const char *path, const char *pattern)
+static void file_index_free(FileIndex *index)
 {
-	DIR *dir;
-	struct dirent *entry;
+	guint i;
 
-	if(!(dir = opendir(path)))
+	if(index == NULL)
 		return;
 
-	if(!(entry = readdir(dir)))
-		return;
+	g_free(index->blocks);
+	g_free(index->data);
+	g_free(index->name_ranks);
+	g_free(index->path_ranks);
+	for(i = 0; i < index->extension_count; ++i)
+		g_free(index->extensions[i].extension);
+	g_free(index->extensions);
+	g_free(index->extension_ids);
+	for(i = 0; i < index->directory_count; ++i)
+		g_free(index->directories[i].path);
+	g_free(index->directories);
+	g_free(index->infos);
+	g_free(index);
+}
 
-	do
+
+/**********************************************************************/
+static gboolean directories_equal(const FileIndex *a, const FileIndex *b)
+{
+	guint i;
+
+	if(a->directory_count != b->directory_count)
+		return FALSE;
+
+	for(i = 0; i < a->directory_count; ++i)
 	{
-		if(entry->d_type == DT_DIR)
-		{
-			if(strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
-				continue;
+		if(strcmp(a->directories[i].path, b->directories[i].path) != 0 ||
+			 a->directories[i].mtime != b->directories[i].mtime || a->directories[i].ctime != b->directories[i].ctime)
+			return FALSE;
+	}
+	return TRUE;
+}
 
-			gchar *new_path = g_build_filename(path, entry->d_name, NULL);
-			list_directory(store, new_path, pattern);
-			g_free(new_path);
-		}
+
+/**********************************************************************/
+static gboolean file_index_equal(const FileIndex *a, const FileIndex *b)
+{
+	if(a == NULL || b == NULL)
+		return FALSE;
+
+	return a->count == b->count && a->size == b->size && memcmp(a->data, b->data, a->size) == 0 &&
+		directories_equal(a, b);
+}
+
+
+/**********************************************************************/
+/* Reads a varint written by put_varint, FALSE if data ends before it */
+static gboolean read_varint(const guint8 **data, const guint8 *end, guint64 *value)
+{
+	guint shift = 0;
+
+	*value = 0;
+	while(*data < end && shift < 64)
+	{
+		guint8 byte = *(*data)++;
+		*value |= (guint64)(byte & 0x7f) << shift;
+		if(!(byte & 0x80))
+			return TRUE;
+		shift += 7;
+	}
+	return FALSE;
+}
+
+
+/**********************************************************************/
+/* Checks the entries of an index read from the cache file and finds
+ * the start of every block, which is not saved */
+static gboolean file_index_check(FileIndex *index)
+{
+	const guint8 *data = index->data;
+	const guint8 *end = index->data + index->size;
+	guint64 length = 0;
+	guint i;
+
+	index->block_count = (index->count + INDEX_BLOCK_SIZE - 1) / INDEX_BLOCK_SIZE;
+	index->blocks = g_new(guint32, index->block_count + 1);
+
+	for(i = 0; i < index->count; ++i)
+	{
+		guint64 prefix;
+		guint64 suffix;
+		guint64 name_len;
+
+		if(i % INDEX_BLOCK_SIZE == 0)
+			index->blocks[i / INDEX_BLOCK_SIZE] = data - index->data;
+
+		if(!read_varint(&data, end, &prefix) || !read_varint(&data, end, &suffix) || !read_varint(&data, end, &name_len))
+			return FALSE;
+		if(prefix > length || (i % INDEX_BLOCK_SIZE == 0 && prefix != 0) ||
+			 suffix > (guint64)(end - data) || name_len >= prefix + suffix)
+			return FALSE;
+
+		data += suffix;
+		length = prefix + suffix;
+	}
+
+	return data == end;
+}
+
+
+/**********************************************************************/
+static gint compare_directory_records(gconstpointer a, gconstpointer b)
+{
+	return strcmp(((const DirectoryRecord*)a)->path, ((const DirectoryRecord*)b)->path);
+}
+
+
+/**********************************************************************/
+static void directory_records_free(GArray *directories)
+{
+	guint i;
+
+	if(directories == NULL)
+		return;
+
+	for(i = 0; i < directories->len; ++i)
+		g_free(g_array_index(directories, DirectoryRecord, i).path);
+	g_array_free(directories, TRUE);
+}
+
+
+/**********************************************************************/
+/* Takes over the directories of the completely scanned locations */
+static void file_index_set_directories(FileIndex *index, GArray *directories)
+{
+	guint i;
+	guint length = 0;
+
+	g_array_sort(directories, compare_directory_records);
+	for(i = 0; i < directories->len; ++i)
+	{
+		DirectoryRecord *record = &g_array_index(directories, DirectoryRecord, i);
+		if(length > 0 && strcmp(record->path, g_array_index(directories, DirectoryRecord, length - 1).path) == 0)
+			g_free(record->path);
 		else
+			g_array_index(directories, DirectoryRecord, length++) = *record;
+	}
+
+	index->directory_count = length;
+	index->directories = (DirectoryRecord*)g_array_free(directories, FALSE);
+}
+
+
+/**********************************************************************/
+/* Saves an index with its directories so the next session starts with
+ * it and only rereads changed directories */
+static void file_index_save(const FileIndex *index, const gchar *filename)
+{
+	GByteArray *data = g_byte_array_new();
+	gchar *directory = g_path_get_dirname(filename);
+	guint i;
+
+	D(log_debug("%s:%s - %s", __FILE__, __FUNCTION__, filename));
+
+	g_byte_array_append(data, (const guint8*)INDEX_CACHE_MAGIC, strlen(INDEX_CACHE_MAGIC));
+	put_varint(data, index->count);
+	put_varint(data, index->size);
+	g_byte_array_append(data, index->data, index->size);
+	put_varint(data, index->directory_count);
+	for(i = 0; i < index->directory_count; ++i)
+	{
+		const DirectoryRecord *record = &index->directories[i];
+		gsize length = strlen(record->path);
+		put_varint(data, length);
+		g_byte_array_append(data, (const guint8*)record->path, length);
+		put_varint(data, record->mtime + 1);
+		put_varint(data, record->ctime + 1);
+	}
+
+	if(g_mkdir_with_parents(directory, 0755) == 0)
+		g_file_set_contents(filename, (const gchar*)data->data, data->len, NULL);
+
+	g_free(directory);
+	g_byte_array_free(data, TRUE);
+}
+
+
+/**********************************************************************/
+/* Reads an index saved by file_index_save, NULL if there is none or it
+ * is damaged */
+static FileIndex *file_index_load(const gchar *filename)
+{
+	FileIndex *index;
+	gchar *contents;
+	gsize length;
+	const guint8 *data;
+	const guint8 *end;
+	guint64 count;
+	guint64 size;
+	guint64 directory_count;
+	gsize magic_len = strlen(INDEX_CACHE_MAGIC);
+	gboolean valid;
+
+	if(!g_file_get_contents(filename, &contents, &length, NULL))
+		return NULL;
+
+	index = g_malloc0(sizeof(FileIndex));
+	index->serial = g_atomic_int_add(&file_index_serial, 1) + 1;
+	data = (const guint8*)contents + magic_len;
+	end = (const guint8*)contents + length;
+	valid = length >= magic_len && memcmp(contents, INDEX_CACHE_MAGIC, magic_len) == 0 &&
+		read_varint(&data, end, &count) && count <= G_MAXUINT &&
+		read_varint(&data, end, &size) && size <= (guint64)(end - data);
+	if(valid)
+	{
+		index->count = count;
+		index->size = size;
+		index->data = g_malloc(MAX(size, 1));
+		memcpy(index->data, data, size);
+		data += size;
+		valid = file_index_check(index) && read_varint(&data, end, &directory_count) &&
+			directory_count <= (guint64)(end - data);
+	}
+	if(valid)
+	{
+		index->directories = g_new0(DirectoryRecord, directory_count);
+		while(valid && index->directory_count < directory_count)
 		{
-			if((fnmatch(pattern, entry->d_name, 0)) == 0)
-			{
-				GtkTreeIter tree_iter;
-				gtk_list_store_append(store, &tree_iter);
-				gtk_list_store_set(store, &tree_iter, COLUMN_OPEN_FILE_SHORT_NAME, entry->d_name, -1);
-				gtk_list_store_set(store, &tree_iter, COLUMN_OPEN_FILE_PATH, path, -1);
-			}
+			DirectoryRecord *record = &index->directories[index->directory_count];
+			guint64 path_len;
+			guint64 mtime;
+			guint64 ctime;
+
+			valid = read_varint(&data, end, &path_len) && path_len <= (guint64)(end - data);
+			if(!valid)
+				break;
+			record->path = g_strndup((const gchar*)data, path_len);
+			data += path_len;
+			index->directory_count++;
+			valid = read_varint(&data, end, &mtime) && read_varint(&data, end, &ctime);
+			record->mtime = (gint64)mtime - 1;
+			record->ctime = (gint64)ctime - 1;
 		}
-	} while((entry = readdir(dir)));
-	closedir(dir);
+		valid = valid && data == end;
+	}
+	g_free(contents);
+
+	if(!valid)
+	{
+		file_index_free(index);
+		return NULL;
+	}
+	return index;
 }
-#endif
+
 
 /**********************************************************************/
-static GtkTreeModel* get_files()
+static void index_cursor_init(IndexCursor *cursor, const FileIndex *index, guint block)
 {
-	GtkListStore *store = gtk_list_store_new(OPEN_FILE_COLUMN_COUNT,
-																					 G_TYPE_STRING,
-																					 G_TYPE_STRING);
+	cursor->index = index;
+	cursor->id = 0;
+	cursor->next_id = block * INDEX_BLOCK_SIZE;
+	cursor->offset = block < index->block_count ? index->blocks[block] : index->size;
+	cursor->path = g_string_sized_new(256);
+	cursor->name_len = 0;
+}
 
-	D(log_debug("%s:%s", __FILE__, __FUNCTION__));
 
-	GSList *iter;
-	GSList *locations = load_configuration();
-	for(iter = locations; iter != NULL; iter = iter->next)
-	{
-		Location *location = (Location*)iter->data;
-#ifdef WIN32
-		list_directory(store, location->path, location->pattern);
-#else
-		wordexp_t expanded_path;
-		wordexp(location->path, &expanded_path, 0);
-		list_directory(store, expanded_path.we_wordv[0], location->pattern);
-		wordfree(&expanded_path);
-#endif
+/**********************************************************************/
+static gboolean index_cursor_next(IndexCursor *cursor)
+{
+	const guint8 *data;
+	gsize prefix;
+	gsize suffix;
+
+	if(cursor->next_id >= cursor->index->count)
+		return FALSE;
+
+	data = cursor->index->data + cursor->offset;
+	prefix = get_varint(&data);
+	suffix = get_varint(&data);
+	cursor->name_len = get_varint(&data);
+
+	g_string_truncate(cursor->path, prefix);
+	g_string_append_len(cursor->path, (const gchar*)data, suffix);
+
+	cursor->offset = data + suffix - cursor->index->data;
+	cursor->id = cursor->next_id++;
+
+	return TRUE;
+}
+
+
+/**********************************************************************/
+/* Continues decoding at the start of a later block */
+static void index_cursor_seek(IndexCursor *cursor, guint block)
+{
+	cursor->next_id = block * INDEX_BLOCK_SIZE;
+	cursor->offset = block < cursor->index->block_count ? cursor->index->blocks[block] : cursor->index->size;
+}
+
+
+/**********************************************************************/
+static void index_cursor_clear(IndexCursor *cursor)
+{
+	g_string_free(cursor->path, TRUE);
+}
+
+
+/**********************************************************************/
+static void file_info_task_free(FileInfoTask *task)
+{
+	g_free(task->ids);
+	g_strfreev(task->paths);
+	g_free(task->infos);
+	g_free(task);
+}
+
+
+/**********************************************************************/
+/* Looks up the files of a task. The paths are in index order, so files
+ * of the same directory follow each other and are looked up relative to
+ * it instead of resolving the whole path every time. */
+static void file_info_worker(gpointer data)
+{
+	FileInfoTask *task = data;
+#if !defined (WIN32)
+	gchar *directory = NULL;
+	int fd = -1;
+#endif
+	guint i;
+
+	/* Stop early once the plugin was unloaded, the result is dropped */
+	for(i = 0; i < task->count && task->load == g_atomic_int_get(&plugin_load); ++i)
+	{
+		const gchar *path = task->paths[i];
+		FileInfo *info = &task->infos[i];
+		gboolean found;
+#if defined (WIN32)
+		GStatBuf buffer;
+		found = g_stat(path, &buffer) == 0;
+#else
+		struct stat buffer;
+		const gchar *name = strrchr(path, PATH_SEPARATOR) + 1;
+		gsize length = name - path;
+
+		if(directory == NULL || strncmp(directory, path, length) != 0 || directory[length] != '\0')
+		{
+			if(fd >= 0)
+				close(fd);
+			g_free(directory);
+			directory = g_strndup(path, length);
+			fd = open(directory, O_RDONLY | O_DIRECTORY);
+		}
+		found = (fd >= 0 ? fstatat(fd, name, &buffer, 0) : stat(path, &buffer)) == 0;
+#endif
+		info->size = found ? (gint64)buffer.st_size : -1;
+		info->mtime = found ? (gint64)buffer.st_mtime : 0;
+	}
+
+#if !defined (WIN32)
+	if(fd >= 0)
+		close(fd);
+	g_free(directory);
+#endif
+	g_async_queue_push(file_info_results, task);
+}
+
+
+/**********************************************************************/
+static gint compare_collation_keys(gconstpointer a, gconstpointer b, gpointer data)
+{
+	gchar **keys = data;
+	guint32 id_a = *(const guint32*)a;
+	guint32 id_b = *(const guint32*)b;
+	gint result = strcmp(keys[id_a], keys[id_b]);
+
+	if(result != 0)
+		return result;
+	return id_a < id_b ? -1 : id_a > id_b;
+}
+
+
+/**********************************************************************/
+/* Stores the position of every entry in the order of its collation key,
+ * entries with equal keys stay in path order */
+static guint32 *rank_collation_keys(gchar **keys, guint count)
+{
+	guint32 *ids = g_new(guint32, count);
+	guint32 *ranks = g_new(guint32, count);
+	guint i;
+
+	for(i = 0; i < count; ++i)
+		ids[i] = i;
+	g_qsort_with_data(ids, count, sizeof(guint32), compare_collation_keys, keys);
+	for(i = 0; i < count; ++i)
+		ranks[ids[i]] = i;
+	g_free(ids);
+
+	return ranks;
+}
+
+
+/**********************************************************************/
+/* Ranks the files of an index by file name and by directory, so the
+ * file list can be sorted by comparing numbers. Files in the same
+ * directory are mostly next to each other in the index and share the
+ * collation key of the directory. */
+static void file_index_rank(FileIndex *index)
+{
+	gchar **name_keys = g_new(gchar*, index->count);
+	gchar **path_keys = g_new(gchar*, index->count);
+	GString *directory = g_string_new(NULL);
+	IndexCursor cursor;
+	guint i;
+
+	index_cursor_init(&cursor, index, 0);
+	while(index_cursor_next(&cursor))
+	{
+		gsize length = cursor.path->len - cursor.name_len - 1;
+
+		name_keys[cursor.id] = g_utf8_collate_key_for_filename(cursor.path->str + length + 1, cursor.name_len);
+		if(cursor.id > 0 && directory->len == length && memcmp(directory->str, cursor.path->str, length) == 0)
+			path_keys[cursor.id] = path_keys[cursor.id - 1];
+		else
+		{
+			g_string_truncate(directory, 0);
+			g_string_append_len(directory, cursor.path->str, length);
+			path_keys[cursor.id] = g_utf8_collate_key_for_filename(directory->str, length);
+		}
+	}
+	index_cursor_clear(&cursor);
+
+	index->name_ranks = rank_collation_keys(name_keys, index->count);
+	index->path_ranks = rank_collation_keys(path_keys, index->count);
+
+	for(i = 0; i < index->count; ++i)
+	{
+		g_free(name_keys[i]);
+		if(i == 0 || path_keys[i] != path_keys[i - 1])
+			g_free(path_keys[i]);
+	}
+	g_free(name_keys);
+	g_free(path_keys);
+	g_string_free(directory, TRUE);
+}
+
+
+/**********************************************************************/
+/* Groups the files of an index by extension, so location patterns and
+ * extension filters select whole buckets instead of matching names */
+static void file_index_partition(FileIndex *index)
+{
+	GHashTable *buckets = g_hash_table_new(g_str_hash, g_str_equal);  /* extension -> ids */
+	GList *extensions;
+	GList *iter;
+	IndexCursor cursor;
+	guint start = 0;
+	guint i;
+
+	index_cursor_init(&cursor, index, 0);
+	while(index_cursor_next(&cursor))
+	{
+		const gchar *name = cursor.path->str + cursor.path->len - cursor.name_len;
+		/* Like fnmatch, "*.c" also matches ".c", so a leading dot counts */
+		const gchar *dot = strrchr(name, '.');
+		const gchar *extension = dot != NULL ? dot + 1 : "";
+		GArray *ids = g_hash_table_lookup(buckets, extension);
+		guint32 id = cursor.id;
+
+		if(ids == NULL)
+		{
+			ids = g_array_new(FALSE, FALSE, sizeof(guint32));
+			g_hash_table_insert(buckets, g_strdup(extension), ids);
+		}
+		g_array_append_val(ids, id);
+	}
+	index_cursor_clear(&cursor);
+
+	extensions = g_list_sort(g_hash_table_get_keys(buckets), (GCompareFunc)strcmp);
+	index->extension_count = g_list_length(extensions);
+	index->extensions = g_new(ExtensionBucket, index->extension_count);
+	index->extension_ids = g_new(guint32, index->count);
+	for(iter = extensions, i = 0; iter != NULL; iter = iter->next, ++i)
+	{
+		GArray *ids = g_hash_table_lookup(buckets, iter->data);
+
+		index->extensions[i].extension = iter->data;
+		index->extensions[i].start = start;
+		index->extensions[i].count = ids->len;
+		memcpy(index->extension_ids + start, ids->data, ids->len * sizeof(guint32));
+		start += ids->len;
+		g_array_free(ids, TRUE);
+	}
+	g_list_free(extensions);
+	g_hash_table_destroy(buckets);
+}
+
+
+/**********************************************************************/
+/* Compares path with the first entry of a block, which is stored whole */
+static gint compare_block_start(const FileIndex *index, guint block, const gchar *path)
+{
+	const guint8 *data = index->data + index->blocks[block];
+	gsize path_len = strlen(path);
+	gsize length;
+	gint result;
+
+	get_varint(&data);
+	length = get_varint(&data);
+	get_varint(&data);
+
+	result = memcmp(data, path, MIN(length, path_len));
+	if(result != 0)
+		return result;
+
+	return (length > path_len) - (length < path_len);
+}
+
+
+/**********************************************************************/
+/* Returns the last block starting at or before path. The index must not
+ * be empty. */
+static guint file_index_find_block(const FileIndex *index, const gchar *path)
+{
+	guint low = 0;
+	guint high = index->block_count;
+
+	while(high - low > 1)
+	{
+		guint middle = (low + high) / 2;
+		if(compare_block_start(index, middle, path) <= 0)
+			low = middle;
+		else
+			high = middle;
+	}
+
+	return low;
+}
+
+
+/**********************************************************************/
+/* Returns the id of the file with the full path, or -1 */
+static gint file_index_find(const FileIndex *index, const gchar *path)
+{
+	IndexCursor cursor;
+	guint low;
+	gint id = -1;
+
+	if(index->block_count == 0)
+		return -1;
+
+	low = file_index_find_block(index, path);
+	index_cursor_init(&cursor, index, low);
+	while(cursor.next_id < (low + 1) * INDEX_BLOCK_SIZE && index_cursor_next(&cursor))
+	{
+		gint result = strcmp(cursor.path->str, path);
+		if(result == 0)
+			id = cursor.id;
+		if(result >= 0)
+			break;
+	}
+	index_cursor_clear(&cursor);
+
+	return id;
+}
+
+
+/**********************************************************************/
+/* Returns the full path of an entry, decoded from the start of its block */
+static gchar *file_index_get_path(const FileIndex *index, guint id, gsize *name_len)
+{
+	IndexCursor cursor;
+	gchar *path;
+
+	index_cursor_init(&cursor, index, id / INDEX_BLOCK_SIZE);
+	while(cursor.next_id <= id)
+		index_cursor_next(&cursor);
+	path = g_strndup(cursor.path->str, cursor.path->len);
+	if(name_len != NULL)
+		*name_len = cursor.name_len;
+	index_cursor_clear(&cursor);
+
+	return path;
+}
+
+/**********************************************************************/
+/* Returns the id of the first file whose path is not before path */
+static guint file_index_lower_bound(const FileIndex *index, const gchar *path)
+{
+	IndexCursor cursor;
+	guint block;
+	guint id;
+
+	if(index->block_count == 0)
+		return 0;
+
+	block = file_index_find_block(index, path);
+	id = MIN((block + 1) * INDEX_BLOCK_SIZE, index->count);
+	index_cursor_init(&cursor, index, block);
+	while(cursor.next_id < id && index_cursor_next(&cursor))
+	{
+		if(strcmp(cursor.path->str, path) >= 0)
+		{
+			id = cursor.id;
+			break;
+		}
+	}
+	index_cursor_clear(&cursor);
+
+	return id;
+}
+
+
+/**********************************************************************/
+/* Returns root followed by exactly one separator, the start of the
+ * paths below it, or NULL for an empty root */
+static gchar *location_prefix(const gchar *root)
+{
+	gsize root_len = strlen(root);
+	gchar *prefix;
+
+	if(root_len == 0)
+		return NULL;
+
+	while(root_len > 1 && G_IS_DIR_SEPARATOR(root[root_len - 1]))
+		root_len--;
+	prefix = g_malloc(root_len + 2);
+	memcpy(prefix, root, root_len);
+	if(!G_IS_DIR_SEPARATOR(prefix[root_len - 1]))
+		prefix[root_len++] = G_DIR_SEPARATOR;
+	prefix[root_len] = '\0';
+
+	return prefix;
+}
+
+
+
+/**********************************************************************/
+static gint compare_words(gconstpointer a, gconstpointer b)
+{
+	return strcmp(*(const gchar**)a, *(const gchar**)b);
+}
+
+
+/**********************************************************************/
+/* Sorts words and joins them with a separator in front of each word
+ * but the first, leaving out duplicates */
+static void append_sorted_words(GString *text, GPtrArray *words, const gchar *separator)
+{
+	guint i;
+
+	g_ptr_array_sort(words, compare_words);
+	for(i = 0; i < words->len; ++i)
+	{
+		if(i > 0 && strcmp(g_ptr_array_index(words, i), g_ptr_array_index(words, i - 1)) == 0)
+			continue;
+		if(text->len > 0)
+			g_string_append_c(text, ' ');
+		g_string_append(text, separator);
+		g_string_append(text, g_ptr_array_index(words, i));
+	}
+}
+
+
+/**********************************************************************/
+/* Returns TRUE if pattern is "*." followed by an extension without
+ * wildcards, which selects a bucket of the index */
+static gboolean is_extension_pattern(const gchar *pattern)
+{
+	return pattern != NULL && g_str_has_prefix(pattern, "*.") && pattern[2] != '\0' &&
+		strpbrk(pattern + 2, "*?[\\.") == NULL;
+}
+
+
+/**********************************************************************/
+/* Returns the search words of a query folded, sorted and separated by
+ * single spaces, followed by the extension filters ("*.c") typed in the
+ * search box in lower case. Queries that only differ in case,
+ * punctuation or word order match the same files, so they share one
+ * cache entry. */
+static gchar *normalize_query(const gchar *text)
+{
+	gchar **parts = g_strsplit_set(text != NULL ? text : "", " \t", -1);
+	GString *rest = g_string_new(NULL);
+	GPtrArray *words = g_ptr_array_new();
+	GPtrArray *extensions = g_ptr_array_new_with_free_func(g_free);
+	GString *query = g_string_new(NULL);
+	gchar **folded;
+	guint i;
+
+	for(i = 0; parts[i] != NULL; ++i)
+	{
+		if(is_extension_pattern(parts[i]))
+			g_ptr_array_add(extensions, g_ascii_strdown(parts[i] + 2, -1));
+		else
+		{
+			g_string_append(rest, parts[i]);
+			g_string_append_c(rest, ' ');
+		}
+	}
+
+	folded = g_str_tokenize_and_fold(rest->str, NULL, NULL);
+	for(i = 0; folded[i] != NULL; ++i)
+		g_ptr_array_add(words, folded[i]);
+	append_sorted_words(query, words, "");
+	append_sorted_words(query, extensions, "*.");
+
+	g_strfreev(folded);
+	g_ptr_array_free(words, TRUE);
+	g_ptr_array_free(extensions, TRUE);
+	g_string_free(rest, TRUE);
+	g_strfreev(parts);
+
+	return g_string_free(query, FALSE);
+}
+
+
+/**********************************************************************/
+static QueryResult *query_result_ref(QueryResult *result)
+{
+	if(result != NULL)
+		result->ref_count++;
+	return result;
+}
+
+
+/**********************************************************************/
+static void sorted_rows_clear(SortedRows *rows)
+{
+	guint key;
+
+	for(key = SORT_BY_NAME; key <= SORT_BY_PATH; ++key)
+	{
+		g_free(rows->ids[key][0]);
+		g_free(rows->ids[key][1]);
+		rows->ids[key][0] = rows->ids[key][1] = NULL;
+	}
+}
+
+
+/**********************************************************************/
+static void query_result_unref(QueryResult *result)
+{
+	if(result == NULL || --result->ref_count > 0)
+		return;
+
+	sorted_rows_clear(&result->rows);
+	g_free(result->ids);
+	g_free(result->bits);
+	g_free(result);
+}
+
+
+/**********************************************************************/
+static gboolean query_result_contains(const QueryResult *result, guint32 id)
+{
+	guint low = 0;
+	guint high = result->count;
+
+	if(result->bits != NULL)
+		return (result->bits[id / 8] >> (id % 8)) & 1;
+
+	while(low < high)
+	{
+		guint middle = low + (high - low) / 2;
+		if(result->ids[middle] == id)
+			return TRUE;
+		if(result->ids[middle] < id)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return FALSE;
+}
+
+
+/**********************************************************************/
+/* Goes through the ids of a result in index order, or through all count
+ * entries of the index if result is NULL. position starts at zero. */
+static gboolean query_result_next(const QueryResult *result, guint count, guint *position, guint32 *id)
+{
+	if(result != NULL && result->ids != NULL)
+	{
+		if(*position >= result->count)
+			return FALSE;
+		*id = result->ids[(*position)++];
+		return TRUE;
+	}
+
+	while(*position < count)
+	{
+		/* Skip entries eight at a time while none of them match */
+		if(result != NULL && *position % 8 == 0 && result->bits[*position / 8] == 0)
+		{
+			*position += 8;
+			continue;
+		}
+		*id = (*position)++;
+		if(result == NULL || query_result_contains(result, *id))
+			return TRUE;
+	}
+	return FALSE;
+}
+
+
+/**********************************************************************/
+/* Returns the ids of a result in index order, of all count entries of
+ * the index if result is NULL */
+static GArray *query_result_get_ids(const QueryResult *result, guint count)
+{
+	GArray *ids = g_array_sized_new(FALSE, FALSE, sizeof(guint32), result != NULL ? result->count : count);
+	guint position = 0;
+	guint32 id;
+
+	while(query_result_next(result, count, &position, &id))
+		g_array_append_val(ids, id);
+
+	return ids;
+}
+
+
+/**********************************************************************/
+static gint compare_ranks(gconstpointer a, gconstpointer b, gpointer data)
+{
+	const guint32 *ranks = data;
+	guint32 rank_a = ranks[*(const guint32*)a];
+	guint32 rank_b = ranks[*(const guint32*)b];
+
+	return rank_a < rank_b ? -1 : rank_a > rank_b;
+}
+
+
+/**********************************************************************/
+/* Returns the ids of the first limit files of a result in the order of
+ * ranks, a ranking of all count entries of the index. Instead of sorting
+ * the whole result, one pass counts its files in ranges of ranks to find
+ * the range of the last file listed, a second one collects the files of
+ * the ranges up to it and only those are sorted. */
+static guint32 *query_result_first_ranked(const QueryResult *result, guint count, const guint32 *ranks,
+                                          gboolean descending, guint limit, guint *length)
+{
+	guint wanted = MIN(limit, result != NULL ? result->count : count);
+	guint shift = 0;
+	guint *ranges;
+	guint last = 0;       /* range of the last file listed */
+	guint collected = 0;
+	guint position = 0;
+	guint32 *ids;
+	guint32 id;
+	guint i;
+
+	*length = wanted;
+	if(wanted == 0)
+		return g_new(guint32, 1);
+
+	/* Ranks are counted from the end when sorting downwards */
+	while((count >> shift) >= RANK_RANGES)
+		shift++;
+	ranges = g_new0(guint, (count >> shift) + 1);
+	while(query_result_next(result, count, &position, &id))
+		ranges[(descending ? count - 1 - ranks[id] : ranks[id]) >> shift]++;
+	while(collected + ranges[last] < wanted)
+		collected += ranges[last++];
+
+	ids = g_new(guint32, collected + ranges[last]);
+	collected = 0;
+	position = 0;
+	while(query_result_next(result, count, &position, &id))
+	{
+		if(((descending ? count - 1 - ranks[id] : ranks[id]) >> shift) <= last)
+			ids[collected++] = id;
+	}
+	g_free(ranges);
+
+	g_qsort_with_data(ids, collected, sizeof(guint32), compare_ranks, (gpointer)ranks);
+	if(descending)
+	{
+		for(i = 0; i < collected / 2; ++i)
+		{
+			guint32 swap = ids[i];
+			ids[i] = ids[collected - 1 - i];
+			ids[collected - 1 - i] = swap;
+		}
+	}
+
+	return ids;
+}
+
+
+/**********************************************************************/
+/* Returns the first rows of a result, NULL for all files, sorted by name
+ * or path. They are sorted once per sort column and order and again only
+ * after the index is replaced. */
+static const guint32 *query_result_get_rows(QueryResult *result, SortKey key, gboolean descending, guint *count)
+{
+	SortedRows *rows = result != NULL ? &result->rows : &all_files_rows;
+
+	if(rows->generation != file_index_generation)
+	{
+		sorted_rows_clear(rows);
+		rows->generation = file_index_generation;
+	}
+	if(rows->ids[key][descending] == NULL)
+	{
+		rows->ids[key][descending] = query_result_first_ranked(result, file_index->count,
+			key == SORT_BY_PATH ? file_index->path_ranks : file_index->name_ranks, descending,
+			FILE_LIST_MAX_ROWS, &rows->count[key][descending]);
+	}
+
+	*count = rows->count[key][descending];
+	return rows->ids[key][descending];
+}
+
+
+/**********************************************************************/
+/* Takes a sorted array of ids and keeps them as a result, in whichever
+ * form is smaller */
+static QueryResult *query_result_new(GArray *ids, guint total)
+{
+	QueryResult *result = g_new0(QueryResult, 1);
+	gsize bits_size = (total + 7) / 8;
+	guint i;
+
+	result->ref_count = 1;
+	result->count = ids->len;
+	if(ids->len * sizeof(guint32) > bits_size)
+	{
+		result->bits = g_malloc0(bits_size);
+		for(i = 0; i < ids->len; ++i)
+		{
+			guint32 id = g_array_index(ids, guint32, i);
+			result->bits[id / 8] |= 1 << (id % 8);
+		}
+		result->size = bits_size;
+		g_array_free(ids, TRUE);
+	}
+	else
+	{
+		result->size = ids->len * sizeof(guint32);
+		result->ids = g_realloc(g_array_free(ids, FALSE), MAX(result->size, 1));
+	}
+
+	return result;
+}
+
+
+/**********************************************************************/
+static gint compare_ids(gconstpointer a, gconstpointer b)
+{
+	guint32 id_a = *(const guint32*)a;
+	guint32 id_b = *(const guint32*)b;
+
+	return id_a < id_b ? -1 : id_a > id_b;
+}
+
+
+/**********************************************************************/
+static void sort_unique_ids(GArray *ids)
+{
+	guint i;
+	guint length = 0;
+
+	g_array_sort(ids, compare_ids);
+	for(i = 0; i < ids->len; ++i)
+		if(length == 0 || g_array_index(ids, guint32, i) != g_array_index(ids, guint32, length - 1))
+			g_array_index(ids, guint32, length++) = g_array_index(ids, guint32, i);
+	g_array_set_size(ids, length);
+}
+
+
+/**********************************************************************/
+/* Returns the ids in both sorted arrays, b may be NULL for all files */
+static GArray *intersect_ids(const GArray *a, const GArray *b)
+{
+	GArray *ids = g_array_new(FALSE, FALSE, sizeof(guint32));
+	guint i = 0;
+	guint j = 0;
+
+	if(b == NULL)
+	{
+		g_array_append_vals(ids, a->data, a->len);
+		return ids;
+	}
+
+	while(i < a->len && j < b->len)
+	{
+		guint32 id_a = g_array_index(a, guint32, i);
+		guint32 id_b = g_array_index(b, guint32, j);
+		if(id_a == id_b)
+			g_array_append_val(ids, id_a);
+		i += id_a <= id_b;
+		j += id_b <= id_a;
+	}
+
+	return ids;
+}
+
+
+/**********************************************************************/
+/* Appends the ids of the files with an extension in [first, end) */
+static void select_extension(const FileIndex *index, const gchar *extension, gboolean ignore_case,
+														 guint first, guint end, GArray *ids)
+{
+	guint i;
+
+	for(i = 0; i < index->extension_count; ++i)
+	{
+		const ExtensionBucket *bucket = &index->extensions[i];
+		const guint32 *bucket_ids = index->extension_ids + bucket->start;
+		guint low = 0;
+		guint high = bucket->count;
+
+		if(ignore_case ? g_ascii_strcasecmp(bucket->extension, extension) != 0 : strcmp(bucket->extension, extension) != 0)
+			continue;
+
+		while(low < high)
+		{
+			guint middle = low + (high - low) / 2;
+			if(bucket_ids[middle] < first)
+				low = middle + 1;
+			else
+				high = middle;
+		}
+		for(; low < bucket->count && bucket_ids[low] < end; ++low)
+			g_array_append_val(ids, bucket_ids[low]);
+	}
+}
+
+
+/**********************************************************************/
+static gboolean location_pattern_match(const gchar *pattern, const gchar *name)
+{
+#ifdef WIN32
+	gchar *lower_pattern = g_utf8_strdown(pattern, -1);
+	gchar *lower_name = g_utf8_strdown(name, -1);
+	gboolean match = g_pattern_match_simple(lower_pattern, lower_name);
+	g_free(lower_pattern);
+	g_free(lower_name);
+	return match;
+#else
+	return fnmatch(pattern, name, 0) == 0;
+#endif
+}
+
+
+/**********************************************************************/
+/* Appends the ids of the files below a location that match its pattern.
+ * "*" takes every file below it and "*.ext" the bucket of the extension,
+ * only other patterns are matched against the file names. */
+static void select_location(const FileIndex *index, const Location *location, GArray *ids)
+{
+	gchar *prefix = location_prefix(location->path);
+	gsize prefix_len;
+	guint first;
+	guint end;
+
+	if(prefix == NULL)
+		return;
+
+	/* The files below the location are between "root/" and "root0" */
+	prefix_len = strlen(prefix);
+	first = file_index_lower_bound(index, prefix);
+	prefix[prefix_len - 1]++;
+	end = file_index_lower_bound(index, prefix);
+	g_free(prefix);
+
+	if(location->pattern == NULL || location->pattern[0] == '\0' || strcmp(location->pattern, "*") == 0 ||
+		strcmp(location->pattern, DEFAULT_PATTERN) == 0)
+	{
+		for(; first < end; ++first)
+			g_array_append_val(ids, first);
+	}
+	else if(is_extension_pattern(location->pattern))
+	{
+#ifdef WIN32
+		select_extension(index, location->pattern + 2, TRUE, first, end, ids);
+#else
+		select_extension(index, location->pattern + 2, FALSE, first, end, ids);
+#endif
+	}
+	else if(first < end)
+	{
+		IndexCursor cursor;
+		index_cursor_init(&cursor, index, first / INDEX_BLOCK_SIZE);
+		while(cursor.next_id < end && index_cursor_next(&cursor))
+			if(cursor.id >= first && location_pattern_match(location->pattern, cursor.path->str + cursor.path->len - cursor.name_len))
+				g_array_append_val(ids, cursor.id);
+		index_cursor_clear(&cursor);
+	}
+}
+
+
+/**********************************************************************/
+/* Returns the sorted ids of the files selected by the patterns of the
+ * configured locations, or NULL if every file of the index is */
+static GArray *select_location_files(const FileIndex *index)
+{
+	GArray *ids = g_array_new(FALSE, FALSE, sizeof(guint32));
+	GSList *iter;
+
+	for(iter = file_locations; iter != NULL; iter = iter->next)
+		select_location(index, iter->data, ids);
+	sort_unique_ids(ids);
+
+	if(ids->len == index->count)
+	{
+		g_array_free(ids, TRUE);
+		return NULL;
+	}
+	return ids;
+}
+
+
+/**********************************************************************/
+/* Appends the ids of the files among candidates[begin, end) whose name
+ * matches the search words. Blocks of the index without candidates are
+ * skipped. candidates may be NULL for all files. */
+static void match_files(const FileIndex *index, const gchar *words, const guint32 *candidates,
+												guint begin, guint end, GArray *ids)
+{
+	IndexCursor cursor;
+	guint i;
+
+	if(begin >= end)
+		return;
+
+	index_cursor_init(&cursor, index, (candidates != NULL ? candidates[begin] : begin) / INDEX_BLOCK_SIZE);
+	for(i = begin; i < end; ++i)
+	{
+		guint32 id = candidates != NULL ? candidates[i] : i;
+
+		if(id / INDEX_BLOCK_SIZE > cursor.next_id / INDEX_BLOCK_SIZE)
+			index_cursor_seek(&cursor, id / INDEX_BLOCK_SIZE);
+		while(cursor.next_id <= id && index_cursor_next(&cursor))
+			;
+
+		if(g_str_match_string(words, cursor.path->str + cursor.path->len - cursor.name_len, TRUE))
+			g_array_append_val(ids, id);
+	}
+	index_cursor_clear(&cursor);
+}
+
+
+/**********************************************************************/
+static void filter_job_unref(FilterJob *job)
+{
+	guint i;
+
+	if(!g_atomic_int_dec_and_test(&job->ref_count))
+		return;
+
+	for(i = 0; i < job->chunk_count; ++i)
+		if(job->chunks[i] != NULL)
+			g_array_free(job->chunks[i], TRUE);
+	g_free(job->chunks);
+	g_mutex_clear(&job->mutex);
+	g_cond_clear(&job->done);
+	g_free(job);
+}
+
+
+/**********************************************************************/
+/* Matches chunks until none are left. The thread that matches the last
+ * one wakes up the main thread waiting in match_candidates. */
+static void filter_job_run(FilterJob *job)
+{
+	guint chunk_size = FILTER_CHUNK_BLOCKS * INDEX_BLOCK_SIZE;
+	gint chunk;
+
+	while((chunk = g_atomic_int_add(&job->next_chunk, 1)) < (gint)job->chunk_count)
+	{
+		match_files(job->index, job->words, job->candidates,
+			chunk * chunk_size, MIN((chunk + 1) * chunk_size, job->total), job->chunks[chunk]);
+		if(g_atomic_int_dec_and_test(&job->pending))
+		{
+			g_mutex_lock(&job->mutex);
+			g_cond_signal(&job->done);
+			g_mutex_unlock(&job->mutex);
+		}
+	}
+}
+
+
+/**********************************************************************/
+static void filter_job_worker(gpointer data)
+{
+	FilterJob *job = data;
+
+	filter_job_run(job);
+	filter_job_unref(job);
+}
+
+
+/**********************************************************************/
+/* Matches the names of the candidate files against the search words,
+ * the same way the file list filtered its rows before results were
+ * cached. Many candidates are split into chunks matched by the worker
+ * pool and the main thread together; the ids of every chunk are sorted
+ * and the chunks are in id order, so the results are simply
+ * concatenated. */
+static GArray *match_candidates(const FileIndex *index, const gchar *words, const GArray *candidates)
+{
+	guint total = candidates != NULL ? candidates->len : index->count;
+	guint chunk_size = FILTER_CHUNK_BLOCKS * INDEX_BLOCK_SIZE;
+	guint chunk_count = (total + chunk_size - 1) / chunk_size;
+	const guint32 *candidate_ids = candidates != NULL ? (const guint32*)candidates->data : NULL;
+	GArray *ids;
+	guint i;
+
+	if(chunk_count <= 1 || worker_count() == 1)
+	{
+		ids = g_array_new(FALSE, FALSE, sizeof(guint32));
+		match_files(index, words, candidate_ids, 0, total, ids);
+	}
+	else
+	{
+		FilterJob *job = g_new0(FilterJob, 1);
+		guint helpers = MIN(worker_count(), chunk_count) - 1;
+
+		job->ref_count = 1 + helpers;
+		job->pending = chunk_count;
+		job->index = index;
+		job->words = words;
+		job->candidates = candidate_ids;
+		job->total = total;
+		job->chunk_count = chunk_count;
+		job->chunks = g_new(GArray*, chunk_count);
+		for(i = 0; i < chunk_count; ++i)
+			job->chunks[i] = g_array_new(FALSE, FALSE, sizeof(guint32));
+		g_mutex_init(&job->mutex);
+		g_cond_init(&job->done);
+
+		for(i = 0; i < helpers; ++i)
+			worker_pool_push(filter_job_worker, job);
+		filter_job_run(job);
+
+		/* Workers may still be matching the chunks they claimed */
+		g_mutex_lock(&job->mutex);
+		while(g_atomic_int_get(&job->pending) > 0)
+			g_cond_wait(&job->done, &job->mutex);
+		g_mutex_unlock(&job->mutex);
+
+		ids = job->chunks[0];
+		job->chunks[0] = NULL;
+		for(i = 1; i < chunk_count; ++i)
+			g_array_append_vals(ids, job->chunks[i]->data, job->chunks[i]->len);
+		filter_job_unref(job);
+	}
+
+	return ids;
+}
+
+
+/**********************************************************************/
+/* Finds the files of the index matching a normalised query. Only the
+ * files selected by the location patterns and the buckets of extension
+ * filters in the query are looked at. */
+static QueryResult *query_result_compute(const FileIndex *index, const gchar *query)
+{
+	gchar **parts = g_strsplit(query, " ", -1);
+	GString *words = g_string_new(NULL);
+	GArray *extension_ids = NULL;
+	GArray *candidates = location_selection;
+	GArray *ids;
+	guint i;
+	D(gint64 started = g_get_monotonic_time());
+
+	for(i = 0; parts[i] != NULL; ++i)
+	{
+		if(g_str_has_prefix(parts[i], "*."))
+		{
+			if(extension_ids == NULL)
+				extension_ids = g_array_new(FALSE, FALSE, sizeof(guint32));
+			select_extension(index, parts[i] + 2, TRUE, 0, index->count, extension_ids);
+		}
+		else if(parts[i][0] != '\0')
+		{
+			if(words->len > 0)
+				g_string_append_c(words, ' ');
+			g_string_append(words, parts[i]);
+		}
+	}
+	g_strfreev(parts);
+
+	if(extension_ids != NULL)
+	{
+		sort_unique_ids(extension_ids);
+		candidates = intersect_ids(extension_ids, location_selection);
+		g_array_free(extension_ids, TRUE);
+	}
+
+	if(words->len > 0)
+		ids = match_candidates(index, words->str, candidates);
+	else if(candidates != NULL)
+		ids = intersect_ids(candidates, NULL);
+	else
+	{
+		ids = g_array_sized_new(FALSE, FALSE, sizeof(guint32), index->count);
+		for(i = 0; i < index->count; ++i)
+			g_array_append_val(ids, i);
+	}
+
+	D(log_debug("%s:%s - %u of %u files for \"%s\", %" G_GINT64_FORMAT " us", __FILE__, __FUNCTION__,
+		ids->len, index->count, query, g_get_monotonic_time() - started));
+
+	if(candidates != location_selection)
+		g_array_free(candidates, TRUE);
+	g_string_free(words, TRUE);
+
+	return query_result_new(ids, index->count);
+}
+
+
+/**********************************************************************/
+/* Counts the sorted rows as if they were all sorted, so the size does
+ * not change while the query is remembered */
+static gsize cached_query_size(const CachedQuery *cached)
+{
+	return sizeof(CachedQuery) + sizeof(QueryResult) + strlen(cached->query) + 1 + cached->result->size +
+		(SORT_BY_PATH + 1) * 2 * MIN(cached->result->count, FILE_LIST_MAX_ROWS) * sizeof(guint32);
+}
+
+
+/**********************************************************************/
+static void cached_query_free(CachedQuery *cached)
+{
+	query_result_unref(cached->result);
+	g_free(cached->query);
+	g_free(cached);
+}
+
+
+/**********************************************************************/
+static void query_cache_clear(void)
+{
+	CachedQuery *cached;
+
+	while((cached = g_queue_pop_head(&query_cache_order)) != NULL)
+		cached_query_free(cached);
+	if(query_cache != NULL)
+		g_hash_table_remove_all(query_cache);
+	query_cache_size = 0;
+	sorted_rows_clear(&all_files_rows);
+
+	if(location_selection != NULL)
+	{
+		g_array_free(location_selection, TRUE);
+		location_selection = NULL;
+	}
+}
+
+
+/**********************************************************************/
+/* Forgets the results for an older index or configuration */
+static void query_cache_validate(void)
+{
+	if(query_cache_generation == file_index_generation)
+		return;
+
+	query_cache_clear();
+	if(file_index != NULL)
+		location_selection = select_location_files(file_index);
+	query_cache_generation = file_index_generation;
+}
+
+
+/**********************************************************************/
+/* Remembers a query result, forgetting the least recently used ones
+ * until it fits in the memory budget */
+static void query_cache_insert(const gchar *query, QueryResult *result)
+{
+	CachedQuery *cached = g_new0(CachedQuery, 1);
+	gsize size;
+
+	cached->query = g_strdup(query);
+	cached->result = query_result_ref(result);
+	size = cached_query_size(cached);
+	if(size > QUERY_CACHE_BUDGET)
+	{
+		cached_query_free(cached);
+		return;
+	}
+
+	while(query_cache_size + size > QUERY_CACHE_BUDGET)
+	{
+		CachedQuery *oldest = g_queue_pop_tail(&query_cache_order);
+		query_cache_size -= cached_query_size(oldest);
+		g_hash_table_remove(query_cache, oldest->query);
+		cached_query_free(oldest);
+	}
+
+	if(query_cache == NULL)
+		query_cache = g_hash_table_new(g_str_hash, g_str_equal);
+	g_queue_push_head(&query_cache_order, cached);
+	cached->link = query_cache_order.head;
+	g_hash_table_insert(query_cache, cached->query, cached);
+	query_cache_size += size;
+}
+
+
+/**********************************************************************/
+/* Returns the number of files the location patterns select */
+static guint selected_file_count(void)
+{
+	if(file_index == NULL)
+		return 0;
+
+	query_cache_validate();
+	return location_selection != NULL ? location_selection->len : file_index->count;
+}
+
+
+/**********************************************************************/
+/* Returns the files of the current index matching the text entered in
+ * the dialog, or NULL if every file matches. Recent queries are looked
+ * up in the cache, which is emptied when a new index is published or
+ * the configuration changes. */
+static QueryResult *get_query_result(const gchar *text)
+{
+	gchar *query;
+	CachedQuery *cached = NULL;
+	QueryResult *result;
+
+	if(file_index == NULL)
+		return NULL;
+
+	query_cache_validate();
+	query = normalize_query(text);
+	if(query[0] == '\0' && location_selection == NULL)
+	{
+		g_free(query);
+		return NULL;
+	}
+
+	if(query_cache != NULL)
+		cached = g_hash_table_lookup(query_cache, query);
+	if(cached != NULL)
+	{
+		g_queue_unlink(&query_cache_order, cached->link);
+		g_queue_push_head_link(&query_cache_order, cached->link);
+		result = query_result_ref(cached->result);
+	}
+	else
+	{
+		result = query_result_compute(file_index, query);
+		query_cache_insert(query, result);
+	}
+	g_free(query);
+
+	return result;
+}
+
+
+/**********************************************************************/
+static void index_add_file(LocationScan *scan, const gchar *path, const gchar *name)
+{
+	ScanFile file;
+
+	file.path = g_build_filename(path, name, NULL);
+	file.name_len = strlen(name);
+	g_array_append_val(scan->files, file);
+}
+
+
+/**********************************************************************/
+static void scan_files_free(GArray *files)
+{
+	guint i;
+
+	for(i = 0; i < files->len; ++i)
+		g_free(g_array_index(files, ScanFile, i).path);
+	g_array_free(files, TRUE);
+}
+
+
+/**********************************************************************/
+/* Returns the length of the directory part of the path of a file */
+static gsize scan_file_directory_length(const ScanFile *file)
+{
+	gsize length = strlen(file->path) - file->name_len;
+
+	return length > 1 ? length - 1 : length;
+}
+
+
+/**********************************************************************/
+static gint compare_directories(const gchar *a, gsize a_len, const gchar *b, gsize b_len)
+{
+	gint result = memcmp(a, b, MIN(a_len, b_len));
+
+	if(result != 0)
+		return result;
+	return a_len < b_len ? -1 : a_len > b_len;
+}
+
+
+/**********************************************************************/
+static gint compare_scan_files_by_directory(gconstpointer a, gconstpointer b)
+{
+	const ScanFile *file_a = a;
+	const ScanFile *file_b = b;
+	gint result = compare_directories(file_a->path, scan_file_directory_length(file_a),
+		file_b->path, scan_file_directory_length(file_b));
+
+	return result != 0 ? result : strcmp(file_a->path, file_b->path);
+}
+
+
+/**********************************************************************/
+/* Checks the budgets of a location scan, once for every directory entry
+ * read or, with entry unset, for every directory opened */
+static gboolean location_scan_stopped(LocationScan *scan, gboolean entry)
+{
+	if(scan->status != SCAN_RUNNING || g_atomic_int_get(&scan->cancelled))
+		return TRUE;
+
+	if(entry && ++scan->entries > LOCATION_MAX_ENTRIES)
+		scan->status = SCAN_TOO_MANY;
+	else if((!entry || scan->entries % 256 == 0) && g_get_monotonic_time() > scan->deadline)
+		scan->status = SCAN_TIMED_OUT;
+
+	return scan->status != SCAN_RUNNING;
+}
+
+
+/**********************************************************************/
+/* Keeps the background scan from competing with Geany for CPU and disk */
+static void lower_thread_priority(void)
+{
+#if defined (WIN32)
+	SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+#elif defined (__linux__)
+	/* On Linux both only affect the calling thread */
+	setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+	syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+#endif
+}
+
+
+/**********************************************************************/
+/* Returns the name of the file system of path if it is known to be slow
+ * to list, e.g. a network or FUSE mount, otherwise NULL */
+static const gchar *slow_file_system(const gchar *path)
+{
+#if defined (WIN32)
+	const gchar *type = NULL;
+	gchar *root = g_strndup(path, g_path_skip_root(path) != NULL ? g_path_skip_root(path) - path : 0);
+	if(root[0] != '\0' && GetDriveType(root) == DRIVE_REMOTE)
+		type = "network";
+	g_free(root);
+	return type;
+#elif defined (__linux__)
+	static const struct
+	{
+		guint32      magic;
+		const gchar *name;
+	} slow_types[] = {
+		{ 0x6969, "nfs" },
+		{ 0x517b, "smb" },
+		{ 0xff534d42, "cifs" },
+		{ 0xfe534d42, "smb2" },
+		{ 0x65735546, "fuse" },
+		{ 0x01021997, "9p" },
+		{ 0x5346414f, "afs" },
+		{ 0x6b414653, "afs" },
+		{ 0x00c36400, "ceph" },
+		{ 0x73757245, "coda" },
+		{ 0x564c, "ncp" }
+	};
+	struct statfs info;
+	guint i;
+
+	if(statfs(path, &info) != 0)
+		return NULL;
+
+	for(i = 0; i < G_N_ELEMENTS(slow_types); ++i)
+	{
+		if((guint32)info.f_type == slow_types[i].magic)
+			return slow_types[i].name;
+	}
+	return NULL;
+#else
+	(void)path;
+	return NULL;
+#endif
+}
+
+#if defined (WIN32)
+
+/**********************************************************************/
+static void list_files_in_dir(LocationScan *scan, const char *path)
+{
+	WIN32_FIND_DATA ff;
+
+	D(log_debug("%s:%s - path: %s", __FILE__, __FUNCTION__, path));
+
+	gchar *full_path = g_build_filename(path, "*", NULL);
+	gchar *path_name = g_locale_to_utf8(path, -1, NULL, NULL, NULL);
+
+	HANDLE findhandle = FindFirstFile(full_path, &ff);
+	if(findhandle != INVALID_HANDLE_VALUE)
+	{
+		do
+		{
+			if(location_scan_stopped(scan, TRUE))
+				break;
+
+			if(!(ff.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+			{
+				gchar *file_name = g_locale_to_utf8(ff.cFileName, -1, NULL, NULL, NULL);
+				if(file_name != NULL && path_name != NULL)
+					index_add_file(scan, path_name, file_name);
+				g_free(file_name);
+			}
+
+			if(scan->readdir_delay > 0)
+				g_usleep(scan->readdir_delay);
+		}while(FindNextFile(findhandle, &ff));
+
+		FindClose(findhandle);
+	}
+	g_free(path_name);
+	g_free(full_path);
+}
+
+/**********************************************************************/
+static void list_directory(LocationScan *scan, const char *path)
+{
+	WIN32_FIND_DATA ff;
+
+	D(log_debug("%s:%s", __FILE__, __FUNCTION__));
+
+	if(location_scan_stopped(scan, FALSE))
+		return;
+
+	list_files_in_dir(scan, path);
+
+	gchar *full_path = g_build_filename(path, "*.*", NULL);
+	HANDLE findhandle = FindFirstFile(full_path, &ff);
+	if(findhandle != INVALID_HANDLE_VALUE)
+	{
+		do
+		{
+			if(location_scan_stopped(scan, FALSE))
+				break;
+
+			if((ff.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && g_strcmp0(ff.cFileName, ".") != 0 && g_strcmp0(ff.cFileName, "..") != 0)
+			{
+				gchar *new_path = g_build_filename(path, ff.cFileName, NULL);
+				list_directory(scan, new_path);
+				g_free(new_path);
+			}
+
+		}while(FindNextFile(findhandle, &ff));
+
+		FindClose(findhandle);
+	}
+
+	g_free(full_path);
+}
+
+#else
+
+/**********************************************************************/
+/* Returns the modification and change times of a directory in ns */
+static void get_directory_times(const struct stat *info, gint64 *mtime, gint64 *ctime)
+{
+#ifdef __APPLE__
+	*mtime = (gint64)info->st_mtimespec.tv_sec * 1000000000 + info->st_mtimespec.tv_nsec;
+	*ctime = (gint64)info->st_ctimespec.tv_sec * 1000000000 + info->st_ctimespec.tv_nsec;
+#else
+	*mtime = (gint64)info->st_mtim.tv_sec * 1000000000 + info->st_mtim.tv_nsec;
+	*ctime = (gint64)info->st_ctim.tv_sec * 1000000000 + info->st_ctim.tv_nsec;
+#endif
+}
+
+
+/**********************************************************************/
+/* Records the times of a directory that was just read. A directory
+ * changed so recently that it could change again within the same time
+ * stamp is read again by the next scan. */
+static void add_directory_record(LocationScan *scan, const char *path, gint64 mtime, gint64 ctime)
+{
+	DirectoryRecord record;
+	gint64 now = g_get_real_time() * 1000;
+
+	record.path = g_strdup(path);
+	record.mtime = now - MAX(mtime, ctime) < RACY_DIRECTORY_TIME * 1000 ? -1 : mtime;
+	record.ctime = ctime;
+	g_array_append_val(scan->directories, record);
+}
+
+
+/**********************************************************************/
+static const DirectoryRecord *find_old_directory(LocationScan *scan, const char *path)
+{
+	DirectoryRecord key;
+
+	if(scan->old_directories->len == 0)
+		return NULL;
+
+	key.path = (gchar*)path;
+	return bsearch(&key, scan->old_directories->data, scan->old_directories->len,
+		sizeof(DirectoryRecord), compare_directory_records);
+}
+
+
+/**********************************************************************/
+static void list_directory(LocationScan *scan, const char *path)
+{
+	DIR *dir;
+	struct dirent *entry;
+	struct stat info;
+	gint64 mtime;
+	gint64 ctime;
+
+	if(location_scan_stopped(scan, FALSE))
+		return;
+
+	if(!(dir = opendir(path)))
+		return;
+
+	if(fstat(dirfd(dir), &info) == 0)
+	{
+		get_directory_times(&info, &mtime, &ctime);
+		add_directory_record(scan, path, mtime, ctime);
+	}
+
+	for(;;)
+	{
+		if(scan->readdir_delay > 0)
+			g_usleep(scan->readdir_delay);
+
+		if(!(entry = readdir(dir)) || location_scan_stopped(scan, TRUE))
+			break;
+
+		if(entry->d_type == DT_DIR)
+		{
+			if(strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+				continue;
+
+			/* Directories known from the last scan are revalidated on their own */
+			gchar *new_path = g_build_filename(path, entry->d_name, NULL);
+			if(find_old_directory(scan, new_path) == NULL)
+				list_directory(scan, new_path);
+			g_free(new_path);
+		}
+		else
+			index_add_file(scan, path, entry->d_name);
+	}
+	closedir(dir);
+}
+
+
+/**********************************************************************/
+/* Takes the files a directory had at the last scan */
+static void reuse_directory_files(LocationScan *scan, const gchar *path)
+{
+	gsize path_len = strlen(path);
+	guint low = 0;
+	guint high = scan->old_files->len;
+
+	while(low < high)
+	{
+		guint middle = low + (high - low) / 2;
+		const ScanFile *file = &g_array_index(scan->old_files, ScanFile, middle);
+		if(compare_directories(file->path, scan_file_directory_length(file), path, path_len) < 0)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	for(; low < scan->old_files->len; ++low)
+	{
+		ScanFile *file = &g_array_index(scan->old_files, ScanFile, low);
+		if(compare_directories(file->path, scan_file_directory_length(file), path, path_len) != 0)
+			break;
+		g_array_append_val(scan->files, *file);
+		file->path = NULL;
+	}
+}
+
+
+/**********************************************************************/
+/* Rescans a location from the directories of the last scan. Only the
+ * directories themselves are looked at, those with the same times as
+ * at the last scan keep their files and only changed ones are read. */
+static void revalidate_location(LocationScan *scan)
+{
+	guint i;
+
+	D(log_debug("%s:%s - %u directories", __FILE__, __FUNCTION__, scan->old_directories->len));
+
+	for(i = 0; i < scan->old_directories->len; ++i)
+	{
+		const DirectoryRecord *record = &g_array_index(scan->old_directories, DirectoryRecord, i);
+		gboolean root = strcmp(record->path, scan->location->path) == 0;
+		struct stat info;
+		gint64 mtime;
+		gint64 ctime;
+
+		if(location_scan_stopped(scan, FALSE))
+			return;
+
+		/* Removed directories are left out together with their files.
+		 * Like the full scan only the location itself may be a link. */
+		if((root ? stat(record->path, &info) : lstat(record->path, &info)) != 0 || !S_ISDIR(info.st_mode))
+			continue;
+
+		get_directory_times(&info, &mtime, &ctime);
+		if(record->mtime == mtime && record->ctime == ctime)
+		{
+			add_directory_record(scan, record->path, mtime, ctime);
+			reuse_directory_files(scan, record->path);
+		}
+		else
+			list_directory(scan, record->path);
+	}
+}
+#endif
+
+/**********************************************************************/
+/* Copies the configured locations with their paths expanded, so the
+ * scan thread does not need to call wordexp() */
+static GSList* expand_locations(GSList *locations)
+{
+	GSList *iter;
+	GSList *expanded = NULL;
+
+	for(iter = locations; iter != NULL; iter = iter->next)
+	{
+		Location *location = (Location*)iter->data;
+		Location *copy = g_malloc0(sizeof(Location));
+#ifdef WIN32
+		copy->path = g_strdup(location->path);
+#else
+		wordexp_t expanded_path;
+		if(wordexp(location->path, &expanded_path, 0) == 0)
+		{
+			copy->path = g_strdup(expanded_path.we_wordc > 0 ? expanded_path.we_wordv[0] : location->path);
+			wordfree(&expanded_path);
+		}
+		else
+			copy->path = g_strdup(location->path);
+#endif
+		copy->pattern = g_strdup(location->pattern);
+		expanded = g_slist_prepend(expanded, copy);
+	}
+
+	return g_slist_reverse(expanded);
+}
+
+
+/**********************************************************************/
+static GSList* copy_locations(GSList *locations)
+{
+	GSList *iter;
+	GSList *copies = NULL;
+
+	for(iter = locations; iter != NULL; iter = iter->next)
+	{
+		Location *location = (Location*)iter->data;
+		Location *copy = g_malloc0(sizeof(Location));
+		copy->path = g_strdup(location->path);
+		copy->pattern = g_strdup(location->pattern);
+		copies = g_slist_prepend(copies, copy);
+	}
+
+	return g_slist_reverse(copies);
+}
+
+
+/**********************************************************************/
+/* Loads the configured locations. The patterns only select files of the
+ * index, so the locations need to be rescanned only if TRUE is returned
+ * because a path changed. */
+static gboolean update_file_locations(void)
+{
+	GSList *configured = load_configuration();
+	GSList *locations = expand_locations(configured);
+	GSList *a;
+	GSList *b;
+	gboolean paths_changed = g_slist_length(locations) != g_slist_length(file_locations);
+
+	for(a = locations, b = file_locations; !paths_changed && a != NULL; a = a->next, b = b->next)
+		paths_changed = g_strcmp0(((Location*)a->data)->path, ((Location*)b->data)->path) != 0;
+
+	clear_configuration(configured);
+	clear_configuration(file_locations);
+	file_locations = locations;
+	file_index_generation++;
+
+	return paths_changed;
+}
+
+
+/**********************************************************************/
+/* Counts the abandoned scan threads of a location that are still
+ * running, by delta */
+static void hung_location_add(const gchar *path, gint delta)
+{
+	gint count;
+
+	g_mutex_lock(&hung_locations_mutex);
+	if(hung_locations == NULL)
+		hung_locations = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	count = GPOINTER_TO_INT(g_hash_table_lookup(hung_locations, path)) + delta;
+	if(count > 0)
+		g_hash_table_insert(hung_locations, g_strdup(path), GINT_TO_POINTER(count));
+	else
+		g_hash_table_remove(hung_locations, path);
+	g_mutex_unlock(&hung_locations_mutex);
+}
+
+
+/**********************************************************************/
+static gboolean is_hung_location(const gchar *path)
+{
+	gboolean hung;
+
+	g_mutex_lock(&hung_locations_mutex);
+	hung = hung_locations != NULL && g_hash_table_lookup(hung_locations, path) != NULL;
+	g_mutex_unlock(&hung_locations_mutex);
+
+	return hung;
+}
+
+
+/**********************************************************************/
+static void location_scan_free(LocationScan *scan)
+{
+	g_free(scan->location->path);
+	g_free(scan->location->pattern);
+	g_free(scan->location);
+	scan_files_free(scan->files);
+	scan_files_free(scan->old_files);
+	directory_records_free(scan->directories);
+	directory_records_free(scan->old_directories);
+	g_free(scan);
+}
+
+
+/**********************************************************************/
+static gpointer location_scan_thread(gpointer data)
+{
+	LocationScan *scan = data;
+
+	D(log_debug("%s:%s - path: %s", __FILE__, __FUNCTION__, scan->location->path));
+
+	lower_thread_priority();
+
+	scan->fs_type = slow_file_system(scan->location->path);
+	if(scan->fs_type != NULL)
+		g_atomic_int_set(&scan->slow, TRUE);
+	scan->deadline = scan->started + (scan->fs_type != NULL ? SLOW_LOCATION_SCAN_TIME : LOCATION_SCAN_TIME);
+
+	if(scan->fs_type != NULL && scan->skip_slow)
+		scan->status = SCAN_KEPT;
+	else if(!g_file_test(scan->location->path, G_FILE_TEST_IS_DIR))
+		scan->status = SCAN_FAILED;
+	else
+	{
+#if defined (WIN32)
+		list_directory(scan, scan->location->path);
+#else
+		if(find_old_directory(scan, scan->location->path) != NULL)
+			revalidate_location(scan);
+		else
+		{
+			/* Records of nested locations cover only part of the tree, it
+			 * is read completely without skipping their directories */
+			guint i;
+			for(i = 0; i < scan->old_directories->len; ++i)
+				g_free(g_array_index(scan->old_directories, DirectoryRecord, i).path);
+			g_array_set_size(scan->old_directories, 0);
+			list_directory(scan, scan->location->path);
+		}
+#endif
+		if(scan->status == SCAN_RUNNING)
+			scan->status = SCAN_DONE;
+	}
+
+	if(g_atomic_int_compare_and_exchange(&scan->state, LOCATION_RUNNING, LOCATION_FINISHED))
+		g_async_queue_push(scan->finished, scan);
+	else
+	{
+		hung_location_add(scan->location->path, -1);
+		location_scan_free(scan);
+	}
+
+	return NULL;
+}
+
+
+/**********************************************************************/
+/* Adds the files under root in index to files, for locations that were
+ * not (completely) rescanned */
+static void keep_location_files(GArray *files, const FileIndex *index, const gchar *root)
+{
+	IndexCursor cursor;
+	gchar *prefix;
+	gsize root_len;
+
+	if(index == NULL || index->count == 0 || (prefix = location_prefix(root)) == NULL)
+		return;
+
+	root_len = strlen(prefix);
+	index_cursor_init(&cursor, index, file_index_find_block(index, prefix));
+	while(index_cursor_next(&cursor))
+	{
+		gint result = strncmp(cursor.path->str, prefix, root_len);
+		if(result < 0)
+			continue;
+		if(result > 0)
+			break;
+
+		ScanFile file;
+		file.path = g_strdup(cursor.path->str);
+		file.name_len = cursor.name_len;
+		g_array_append_val(files, file);
+	}
+	index_cursor_clear(&cursor);
+	g_free(prefix);
+}
+
+
+/**********************************************************************/
+/* Copies the records of root and the directories below it */
+static void keep_location_directories(GArray *directories, const FileIndex *index, const gchar *root)
+{
+	gchar *prefix;
+	gsize prefix_len;
+	guint low = 0;
+	guint high;
+
+	if(index == NULL || index->directory_count == 0 || (prefix = location_prefix(root)) == NULL)
+		return;
+
+	/* root itself is the prefix without its separator, unless it is "/" */
+	prefix_len = strlen(prefix);
+	high = index->directory_count;
+	while(low < high)
+	{
+		guint middle = low + (high - low) / 2;
+		if(strncmp(index->directories[middle].path, prefix, MAX(prefix_len - 1, 1)) < 0)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	for(; low < index->directory_count; ++low)
+	{
+		const gchar *path = index->directories[low].path;
+		DirectoryRecord record;
+
+		if(strncmp(path, prefix, prefix_len) != 0 &&
+			 !(prefix_len > 1 && strncmp(path, prefix, prefix_len - 1) == 0 && path[prefix_len - 1] == '\0'))
+		{
+			if(strcmp(path, prefix) > 0)
+				break;
+			continue;
+		}
+
+		record = index->directories[low];
+		record.path = g_strdup(path);
+		g_array_append_val(directories, record);
+	}
+	g_free(prefix);
+}
+
+
+/**********************************************************************/
+/* Starts scanning a location. The files and directories it had in the
+ * previous index are copied for the thread, as that index can be freed
+ * while the thread runs. Returns NULL if a scan of it that was given up
+ * on is still running. */
+static LocationScan *location_scan_start(IndexScan *parent, const Location *location, const FileIndex *previous)
+{
+	LocationScan *scan;
+	gsize path_len = strlen(location->path);
+	gchar *path;
+
+	/* Paths below the location are built without a separator at its end */
+	while(path_len > 1 && G_IS_DIR_SEPARATOR(location->path[path_len - 1]))
+		path_len--;
+	path = g_strndup(location->path, path_len);
+
+	/* A new thread would block on the same file system as the one given
+	 * up on, the files published before are kept until it is done */
+	if(is_hung_location(path))
+	{
+		g_free(path);
+		return NULL;
+	}
+
+	scan = g_malloc0(sizeof(LocationScan));
+	scan->location = g_malloc0(sizeof(Location));
+	scan->location->path = path;
+	scan->location->pattern = g_strdup(location->pattern);
+	scan->directories = g_array_new(FALSE, FALSE, sizeof(DirectoryRecord));
+	scan->old_directories = g_array_new(FALSE, FALSE, sizeof(DirectoryRecord));
+	scan->old_files = g_array_new(FALSE, FALSE, sizeof(ScanFile));
+	keep_location_directories(scan->old_directories, previous, scan->location->path);
+	if(scan->old_directories->len > 0)
+	{
+		keep_location_files(scan->old_files, previous, scan->location->path);
+		g_array_sort(scan->old_files, compare_scan_files_by_directory);
+	}
+	scan->skip_slow = parent->refresh;
+	scan->readdir_delay = parent->readdir_delay;
+	scan->finished = parent->finished;
+	scan->files = g_array_new(FALSE, FALSE, sizeof(ScanFile));
+	scan->status = SCAN_RUNNING;
+	scan->started = g_get_monotonic_time();
+	scan->thread = g_thread_new("open-file-location", location_scan_thread, scan);
+
+	return scan;
+}
+
+
+/**********************************************************************/
+/* When the scan of a location gets stuck in the file system, its thread
+ * is left behind after the time budget and a grace period */
+static gint64 location_abandon_time(LocationScan *scan)
+{
+	gint64 budget = g_atomic_int_get(&scan->slow) ? SLOW_LOCATION_SCAN_TIME : LOCATION_SCAN_TIME;
+
+	return scan->started + budget + LOCATION_GRACE_TIME;
+}
+
+
+/**********************************************************************/
+static void location_statuses_free(GArray *statuses)
+{
+	guint i;
+
+	if(statuses == NULL)
+		return;
+
+	for(i = 0; i < statuses->len; ++i)
+		g_free(g_array_index(statuses, LocationStatus, i).path);
+	g_array_free(statuses, TRUE);
+}
+
+
+/**********************************************************************/
+static GArray *location_statuses_copy(GArray *statuses)
+{
+	GArray *copy = g_array_sized_new(FALSE, FALSE, sizeof(LocationStatus), statuses->len);
+	guint i;
+
+	for(i = 0; i < statuses->len; ++i)
+	{
+		LocationStatus status = g_array_index(statuses, LocationStatus, i);
+		status.path = g_strdup(status.path);
+		g_array_append_val(copy, status);
+	}
+
+	return copy;
+}
+
+
+/**********************************************************************/
+static gboolean on_index_updated(gpointer data);
+
+/* Builds an index from the locations scanned so far, with the files of
+ * the others taken from the last published index, and publishes it */
+static void index_scan_publish(IndexScan *scan, LocationScan **locations, GArray *statuses, const FileIndex **published, gboolean last)
+{
+	IndexUpdate *update = g_malloc0(sizeof(IndexUpdate));
+	GArray *files = g_array_new(FALSE, FALSE, sizeof(ScanFile));
+	GArray *kept = g_array_new(FALSE, FALSE, sizeof(ScanFile));
+	GArray *directories = g_array_new(FALSE, FALSE, sizeof(DirectoryRecord));
+	guint i;
+	guint j;
+
+	for(i = 0; i < statuses->len; ++i)
+	{
+		LocationStatus *status = &g_array_index(statuses, LocationStatus, i);
+		if(status->status == SCAN_RUNNING && g_atomic_int_get(&locations[i]->slow))
+			status->fs_type = locations[i]->fs_type;
+
+		if(status->status == SCAN_RUNNING || status->status == SCAN_KEPT || status->status == SCAN_NOT_RESPONDING)
+		{
+			keep_location_files(kept, *published, status->path);
+			keep_location_directories(directories, *published, status->path);
+		}
+		else
+			g_array_append_vals(files, locations[i]->files->data, locations[i]->files->len);
+
+		/* A partial scan did not see every directory, its location is
+		 * scanned completely next time */
+		if(status->status == SCAN_DONE)
+		{
+			for(j = 0; j < locations[i]->directories->len; ++j)
+			{
+				DirectoryRecord record = g_array_index(locations[i]->directories, DirectoryRecord, j);
+				record.path = g_strdup(record.path);
+				g_array_append_val(directories, record);
+			}
+		}
+	}
+	g_array_append_vals(files, kept->data, kept->len);
+
+	update->index = file_index_build(files);
+	file_index_set_directories(update->index, directories);
+	if(file_index_equal(*published, update->index))
+	{
+		file_index_free(update->index);
+		update->index = NULL;
+	}
+	else
+	{
+		file_index_rank(update->index);
+		file_index_partition(update->index);
+		*published = update->index;
+		scan->cache_current = FALSE;
+	}
+
+	/* Written before the update is queued, the main thread frees an
+	 * index only once a newer one has been published */
+	if(last && !scan->cache_current && *published != NULL && scan->cache_file != NULL)
+	{
+		file_index_save(*published, scan->cache_file);
+		scan->cache_current = TRUE;
+	}
+	update->statuses = location_statuses_copy(statuses);
+	update->last = last;
+
+	g_array_free(files, TRUE);
+	scan_files_free(kept);
+
+	/* The main thread joins this thread once it has the last update, the
+	 * files of the locations are freed before so that it does not wait */
+	if(last)
+	{
+		for(i = 0; i < statuses->len; ++i)
+		{
+			if(locations[i] != NULL)
+				location_scan_free(locations[i]);
+			locations[i] = NULL;
+		}
+	}
+
+	g_async_queue_push(scan->updates, update);
+	g_idle_add(on_index_updated, scan);
+}
+
+
+/**********************************************************************/
+/* Scans every location on a thread of its own and publishes an updated
+ * index whenever one of them is done */
+static gpointer index_scan_thread(gpointer data)
+{
+	IndexScan *scan = data;
+	const FileIndex *published = scan->previous;
+	guint count = g_slist_length(scan->locations);
+	LocationScan **locations = g_new0(LocationScan*, count);
+	GArray *statuses = g_array_sized_new(FALSE, FALSE, sizeof(LocationStatus), count);
+	guint settled = 0;
+	gboolean published_last = FALSE;
+	gint64 cancel_deadline = G_MAXINT64;
+	GSList *iter;
+	guint i;
+
+	D(log_debug("%s:%s", __FILE__, __FUNCTION__));
+
+	lower_thread_priority();
+
+	for(iter = scan->locations, i = 0; iter != NULL; iter = iter->next, ++i)
+	{
+		LocationStatus status;
+		status.path = g_strdup(((Location*)iter->data)->path);
+		status.fs_type = NULL;
+		status.status = SCAN_RUNNING;
+		status.files = 0;
+		g_array_append_val(statuses, status);
+	}
+
+	/* The index saved last time is shown while its directories are
+	 * revalidated */
+	if(published == NULL && scan->cache_file != NULL)
+	{
+		FileIndex *cached = file_index_load(scan->cache_file);
+		if(cached != NULL)
+		{
+			IndexUpdate *update = g_malloc0(sizeof(IndexUpdate));
+			file_index_rank(cached);
+			file_index_partition(cached);
+			update->index = cached;
+			update->statuses = location_statuses_copy(statuses);
+			g_async_queue_push(scan->updates, update);
+			g_idle_add(on_index_updated, scan);
+			published = cached;
+			scan->cache_current = TRUE;
+		}
+	}
+
+	for(iter = scan->locations, i = 0; iter != NULL; iter = iter->next, ++i)
+	{
+		locations[i] = location_scan_start(scan, iter->data, published);
+		if(locations[i] == NULL)
+		{
+			g_array_index(statuses, LocationStatus, i).status = SCAN_NOT_RESPONDING;
+			settled++;
+		}
+	}
+
+	while(settled < count)
+	{
+		gint64 wake_up = cancel_deadline;
+		gboolean progress = FALSE;
+		gpointer item;
+
+		if(g_atomic_int_get(&scan->cancelled) && cancel_deadline == G_MAXINT64)
+		{
+			cancel_deadline = g_get_monotonic_time() + CANCEL_GRACE_TIME;
+			for(i = 0; i < count; ++i)
+			{
+				if(g_array_index(statuses, LocationStatus, i).status == SCAN_RUNNING)
+					g_atomic_int_set(&locations[i]->cancelled, TRUE);
+			}
+			continue;
+		}
+
+		for(i = 0; i < count; ++i)
+		{
+			if(g_array_index(statuses, LocationStatus, i).status == SCAN_RUNNING)
+				wake_up = MIN(wake_up, location_abandon_time(locations[i]));
+		}
+
+		item = g_async_queue_timeout_pop(scan->finished, MAX(wake_up - g_get_monotonic_time(), 0));
+		if(item == scan)
+			continue;
+
+		for(i = 0; i < count; ++i)
+		{
+			LocationStatus *status = &g_array_index(statuses, LocationStatus, i);
+			LocationScan *location = locations[i];
+
+			if(status->status != SCAN_RUNNING)
+				continue;
+
+			if(location == item)
+			{
+				g_thread_join(location->thread);
+				status->status = location->status;
+				status->fs_type = location->fs_type;
+				status->files = location->files->len;
+			}
+			else if(item == NULL && MIN(location_abandon_time(location), cancel_deadline) <= g_get_monotonic_time())
+			{
+				if(g_atomic_int_get(&location->slow))
+					status->fs_type = location->fs_type;
+				/* If this fails the scan finished just now and is queued.
+				 * Counted before, an abandoned thread may exit right away. */
+				hung_location_add(location->location->path, 1);
+				if(!g_atomic_int_compare_and_exchange(&location->state, LOCATION_RUNNING, LOCATION_ABANDONED))
+				{
+					hung_location_add(location->location->path, -1);
+					continue;
+				}
+				g_thread_unref(location->thread);
+				locations[i] = NULL;
+				status->status = SCAN_NOT_RESPONDING;
+				scan->abandoned = TRUE;
+			}
+			else
+				continue;
+
+			settled++;
+			progress = TRUE;
+		}
+
+		if(progress && !g_atomic_int_get(&scan->cancelled))
+		{
+			published_last = settled == count;
+			index_scan_publish(scan, locations, statuses, &published, published_last);
+		}
+	}
+
+	if(!published_last && !g_atomic_int_get(&scan->cancelled))
+		index_scan_publish(scan, locations, statuses, &published, TRUE);
+	else if(!published_last)
+	{
+		IndexUpdate *update = g_malloc0(sizeof(IndexUpdate));
+		for(i = 0; i < count; ++i)
+		{
+			if(locations[i] != NULL)
+				location_scan_free(locations[i]);
+		}
+		update->last = TRUE;
+		g_async_queue_push(scan->updates, update);
+		g_idle_add(on_index_updated, scan);
+	}
+
+	g_free(locations);
+	location_statuses_free(statuses);
+
+	return NULL;
+}
+
+
+/**********************************************************************/
+static void index_update_free(IndexUpdate *update)
+{
+	file_index_free(update->index);
+	location_statuses_free(update->statuses);
+	g_free(update);
+}
+
+
+/**********************************************************************/
+static void index_scan_free(IndexScan *scan)
+{
+	clear_configuration(scan->locations);
+	g_free(scan->cache_file);
+	g_async_queue_unref(scan->finished);
+	g_async_queue_unref(scan->updates);
+	g_free(scan);
+}
+
+
+/**********************************************************************/
+static void set_title(struct PLUGIN_DATA *plugin_data, const gchar *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	gchar *text = g_strdup_vprintf(format, args);
+	va_end(args);
+
+	gchar *title = g_strconcat(PLUGIN_NAME, " ", text, NULL);
+	gtk_window_set_title(GTK_WINDOW(plugin_data->main_window), title);
+	g_free(title);
+	g_free(text);
+}
+
+
+/**********************************************************************/
+void select_first_row(struct PLUGIN_DATA *plugin_data)
+{
+	GtkTreePath *path = gtk_tree_path_new_from_indices(0, -1);
+	gtk_tree_view_set_cursor(GTK_TREE_VIEW(plugin_data->tree_view), path, NULL, FALSE);
+	gtk_tree_path_free(path);
+}
+
+
+/**********************************************************************/
+static gboolean is_file_info_key(SortKey key)
+{
+	return key == SORT_BY_SIZE || key == SORT_BY_MODIFIED;
+}
+
+
+/**********************************************************************/
+/* Sorting by file information needs all listed files looked up, so it
+ * is only offered for lists that are not too long */
+static void update_file_title(struct PLUGIN_DATA *plugin_data)
+{
+	guint total_rows = selected_file_count();
+	guint filtered_rows = plugin_data->query_result != NULL ? plugin_data->query_result->count : total_rows;
+	gboolean info_sortable = filtered_rows <= (guint)FILE_INFO_SORT_LIMIT;
+	GString *note = g_string_new(NULL);
+
+	gtk_tree_view_column_set_clickable(plugin_data->size_column, info_sortable);
+	gtk_tree_view_column_set_clickable(plugin_data->modified_column, info_sortable);
+
+	if(filtered_rows > FILE_LIST_MAX_ROWS)
+		g_string_append_printf(note, " - showing the first %u", FILE_LIST_MAX_ROWS);
+	if(show_file_details && !info_sortable)
+		g_string_append(note, " - too many files to sort by size or time");
+	set_title(plugin_data, index_thread != NULL ? "%u/%u (indexing...)%s" : "%u/%u%s", filtered_rows, total_rows, note->str);
+	g_string_free(note, TRUE);
+
+	gtk_widget_set_sensitive(plugin_data->open_button, filtered_rows > 0);
+}
+
+
+/**********************************************************************/
+/* Lists the locations that are not completely indexed below the files */
+static void update_location_status(struct PLUGIN_DATA *plugin_data)
+{
+	GString *text = g_string_new(NULL);
+	guint i;
+
+	for(i = 0; location_statuses != NULL && i < location_statuses->len; ++i)
+	{
+		const LocationStatus *status = &g_array_index(location_statuses, LocationStatus, i);
+		gchar *name = status->fs_type != NULL ? g_strdup_printf("%s (%s)", status->path, status->fs_type) : g_strdup(status->path);
+		gint seconds = (status->fs_type != NULL ? SLOW_LOCATION_SCAN_TIME : LOCATION_SCAN_TIME) / G_USEC_PER_SEC;
+
+		switch(status->status)
+		{
+		case SCAN_RUNNING:
+			if(status->fs_type != NULL)
+				g_string_append_printf(text, _("%s: indexing in the background\n"), name);
+			break;
+		case SCAN_KEPT:
+			g_string_append_printf(text, _("%s: slow file system, only rescanned in the background\n"), name);
+			break;
+		case SCAN_TIMED_OUT:
+			g_string_append_printf(text, _("%s: stopped after %d seconds, %u files indexed\n"), name, seconds, status->files);
+			break;
+		case SCAN_TOO_MANY:
+			g_string_append_printf(text, _("%s: stopped after %u entries, %u files indexed\n"), name, LOCATION_MAX_ENTRIES, status->files);
+			break;
+		case SCAN_NOT_RESPONDING:
+			g_string_append_printf(text, _("%s: not responding, showing files from the last scan\n"), name);
+			break;
+		case SCAN_FAILED:
+			g_string_append_printf(text, _("%s: could not be read\n"), name);
+			break;
+		case SCAN_DONE:
+			break;
+		}
+		g_free(name);
+	}
+
+	if(text->len > 0)
+		g_string_truncate(text, text->len - 1);
+	gtk_label_set_text(GTK_LABEL(plugin_data->status_label), text->str);
+	gtk_widget_set_visible(plugin_data->status_label, text->len > 0);
+	g_string_free(text, TRUE);
+}
+
+
+/**********************************************************************/
+static void update_query_result(struct PLUGIN_DATA *plugin_data)
+{
+	query_result_unref(plugin_data->query_result);
+	plugin_data->query_result = get_query_result(plugin_data->text_value);
+}
+
+
+/**********************************************************************/
+/* Sorts listed files by the ranks computed when the index was built
+ * instead of collating their names. Sorted by size or modification
+ * time, files not looked up yet come last and the most recently
+ * modified files first. */
+static gint compare_file_ids(gconstpointer a, gconstpointer b, gpointer data)
+{
+	const struct PLUGIN_DATA *plugin_data = data;
+	const guint32 *ranks = plugin_data->sort_key == SORT_BY_PATH ? file_index->path_ranks : file_index->name_ranks;
+	guint32 id_a = *(const guint32*)a;
+	guint32 id_b = *(const guint32*)b;
+	gint result = 0;
+
+	if(is_file_info_key(plugin_data->sort_key) && file_index->infos != NULL)
+	{
+		const FileInfo *info_a = &file_index->infos[id_a];
+		const FileInfo *info_b = &file_index->infos[id_b];
+		gboolean known_a = info_a->session != 0 && info_a->size >= 0;
+		gboolean known_b = info_b->session != 0 && info_b->size >= 0;
+
+		if(known_a != known_b)
+			result = known_a ? -1 : 1;
+		else if(known_a && plugin_data->sort_key == SORT_BY_SIZE && info_a->size != info_b->size)
+			result = info_a->size < info_b->size ? -1 : 1;
+		else if(known_a && plugin_data->sort_key == SORT_BY_MODIFIED && info_a->mtime != info_b->mtime)
+			result = info_a->mtime > info_b->mtime ? -1 : 1;
+	}
+	if(result == 0)
+		result = ranks[id_a] < ranks[id_b] ? -1 : ranks[id_a] > ranks[id_b];
+
+	return plugin_data->sort_order == GTK_SORT_DESCENDING ? -result : result;
+}
+
+
+/**********************************************************************/
+static guint get_row_id(GtkTreeModel *model, GtkTreeIter *iter)
+{
+	guint id;
+
+	gtk_tree_model_get(model, iter, COLUMN_OPEN_FILE_ID, &id, -1);
+
+	return id;
+}
+
+
+/**********************************************************************/
+/* Returns the id of the file at the cursor of the file list, or -1 */
+static gint get_cursor_id(struct PLUGIN_DATA *plugin_data)
+{
+	GtkTreePath *tree_path = NULL;
+	GtkTreeIter iter;
+	gint id = -1;
+
+	gtk_tree_view_get_cursor(GTK_TREE_VIEW(plugin_data->tree_view), &tree_path, NULL);
+	if(tree_path == NULL)
+		return -1;
+
+	if(gtk_tree_model_get_iter(plugin_data->model, &iter, tree_path))
+		id = get_row_id(plugin_data->model, &iter);
+	gtk_tree_path_free(tree_path);
+
+	return id;
+}
+
+
+/**********************************************************************/
+/* Returns the full path of the file at the cursor of the file list */
+static gchar *get_cursor_file(struct PLUGIN_DATA *plugin_data)
+{
+	gint id = get_cursor_id(plugin_data);
+
+	return id >= 0 && file_index != NULL ? file_index_get_path(file_index, id, NULL) : NULL;
+}
+
+
+/**********************************************************************/
+static GtkTreeViewColumn *get_sort_column(struct PLUGIN_DATA *plugin_data, SortKey key)
+{
+	switch(key)
+	{
+	case SORT_BY_PATH:
+		return plugin_data->path_column;
+	case SORT_BY_SIZE:
+		return plugin_data->size_column;
+	case SORT_BY_MODIFIED:
+		return plugin_data->modified_column;
+	default:
+		return plugin_data->name_column;
+	}
+}
+
+
+/**********************************************************************/
+static void update_sort_indicators(struct PLUGIN_DATA *plugin_data)
+{
+	SortKey key;
+
+	for(key = SORT_BY_NAME; key < SORT_KEY_COUNT; ++key)
+	{
+		GtkTreeViewColumn *column = get_sort_column(plugin_data, key);
+		gtk_tree_view_column_set_sort_indicator(column, key == plugin_data->sort_key);
+		gtk_tree_view_column_set_sort_order(column, plugin_data->sort_order);
+	}
+}
+
+
+/**********************************************************************/
+/* Returns the ids of the selected files plus one, used as keys */
+static GHashTable *get_selected_ids(struct PLUGIN_DATA *plugin_data)
+{
+	GHashTable *selected = g_hash_table_new(g_direct_hash, g_direct_equal);
+	GList *rows = gtk_tree_selection_get_selected_rows(plugin_data->selection, NULL);
+	GList *iter;
+
+	for(iter = rows; iter != NULL; iter = iter->next)
+	{
+		GtkTreeIter tree_iter;
+		if(gtk_tree_model_get_iter(plugin_data->model, &tree_iter, iter->data))
+		{
+			gpointer key = GUINT_TO_POINTER(get_row_id(plugin_data->model, &tree_iter) + 1);
+			g_hash_table_insert(selected, key, key);
+		}
+		gtk_tree_path_free(iter->data);
+	}
+	g_list_free(rows);
+
+	return selected;
+}
+
+
+/**********************************************************************/
+static void file_list_model_tree_model_init(GtkTreeModelIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE(FileListModel, file_list_model, G_TYPE_OBJECT,
+                        G_IMPLEMENT_INTERFACE(GTK_TYPE_TREE_MODEL, file_list_model_tree_model_init))
+
+
+/**********************************************************************/
+static void file_list_model_init(FileListModel *model)
+{
+	model->stamp = g_random_int();
+}
+
+
+/**********************************************************************/
+static void file_list_model_finalize(GObject *object)
+{
+	g_free(((FileListModel*)object)->ids);
+
+	G_OBJECT_CLASS(file_list_model_parent_class)->finalize(object);
+}
+
+
+/**********************************************************************/
+static void file_list_model_class_init(FileListModelClass *klass)
+{
+	G_OBJECT_CLASS(klass)->finalize = file_list_model_finalize;
+}
+
+
+/**********************************************************************/
+static GtkTreeModelFlags file_list_model_get_flags(G_GNUC_UNUSED GtkTreeModel *tree_model)
+{
+	return GTK_TREE_MODEL_LIST_ONLY | GTK_TREE_MODEL_ITERS_PERSIST;
+}
+
+
+/**********************************************************************/
+static gint file_list_model_get_n_columns(G_GNUC_UNUSED GtkTreeModel *tree_model)
+{
+	return OPEN_FILE_COLUMN_COUNT;
+}
+
+
+/**********************************************************************/
+static GType file_list_model_get_column_type(G_GNUC_UNUSED GtkTreeModel *tree_model, G_GNUC_UNUSED gint column)
+{
+	return G_TYPE_UINT;
+}
+
+
+/**********************************************************************/
+/* Points iter at a row, the row number is kept in user_data */
+static gboolean file_list_model_set_iter(GtkTreeModel *tree_model, GtkTreeIter *iter, gint row)
+{
+	FileListModel *model = (FileListModel*)tree_model;
+
+	if(row < 0 || (guint)row >= model->count)
+		return FALSE;
+
+	iter->stamp = model->stamp;
+	iter->user_data = GINT_TO_POINTER(row);
+	return TRUE;
+}
+
+
+/**********************************************************************/
+static gboolean file_list_model_get_iter(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreePath *path)
+{
+	if(gtk_tree_path_get_depth(path) != 1)
+		return FALSE;
+
+	return file_list_model_set_iter(tree_model, iter, gtk_tree_path_get_indices(path)[0]);
+}
+
+
+/**********************************************************************/
+static GtkTreePath *file_list_model_get_path(G_GNUC_UNUSED GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	return gtk_tree_path_new_from_indices(GPOINTER_TO_INT(iter->user_data), -1);
+}
+
+
+/**********************************************************************/
+static void file_list_model_get_value(GtkTreeModel *tree_model, GtkTreeIter *iter, G_GNUC_UNUSED gint column, GValue *value)
+{
+	FileListModel *model = (FileListModel*)tree_model;
+
+	g_value_init(value, G_TYPE_UINT);
+	g_value_set_uint(value, model->ids[GPOINTER_TO_INT(iter->user_data)]);
+}
+
+
+/**********************************************************************/
+static gboolean file_list_model_iter_next(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	return file_list_model_set_iter(tree_model, iter, GPOINTER_TO_INT(iter->user_data) + 1);
+}
+
+
+/**********************************************************************/
+static gboolean file_list_model_iter_nth_child(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *parent, gint n)
+{
+	return parent == NULL && file_list_model_set_iter(tree_model, iter, n);
+}
+
+
+/**********************************************************************/
+static gboolean file_list_model_iter_children(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *parent)
+{
+	return file_list_model_iter_nth_child(tree_model, iter, parent, 0);
+}
+
+
+/**********************************************************************/
+static gboolean file_list_model_iter_has_child(G_GNUC_UNUSED GtkTreeModel *tree_model, G_GNUC_UNUSED GtkTreeIter *iter)
+{
+	return FALSE;
+}
+
+
+/**********************************************************************/
+static gint file_list_model_iter_n_children(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	return iter == NULL ? (gint)((FileListModel*)tree_model)->count : 0;
+}
+
+
+/**********************************************************************/
+static gboolean file_list_model_iter_parent(G_GNUC_UNUSED GtkTreeModel *tree_model, G_GNUC_UNUSED GtkTreeIter *iter,
+                                            G_GNUC_UNUSED GtkTreeIter *child)
+{
+	return FALSE;
+}
+
+
+/**********************************************************************/
+static void file_list_model_tree_model_init(GtkTreeModelIface *iface)
+{
+	iface->get_flags = file_list_model_get_flags;
+	iface->get_n_columns = file_list_model_get_n_columns;
+	iface->get_column_type = file_list_model_get_column_type;
+	iface->get_iter = file_list_model_get_iter;
+	iface->get_path = file_list_model_get_path;
+	iface->get_value = file_list_model_get_value;
+	iface->iter_next = file_list_model_iter_next;
+	iface->iter_children = file_list_model_iter_children;
+	iface->iter_has_child = file_list_model_iter_has_child;
+	iface->iter_n_children = file_list_model_iter_n_children;
+	iface->iter_nth_child = file_list_model_iter_nth_child;
+	iface->iter_parent = file_list_model_iter_parent;
+}
+
+
+/**********************************************************************/
+/* Takes over the ids */
+static GtkTreeModel *file_list_model_new(guint32 *ids, guint count)
+{
+	FileListModel *model = g_object_new(file_list_model_get_type(), NULL);
+
+	model->ids = ids;
+	model->count = count;
+
+	return GTK_TREE_MODEL(model);
+}
+
+
+/**********************************************************************/
+/* Returns the ids of the first files of the query result in the order
+ * of the sort column. The order by name or path is kept with the result.
+ * Sorting by file information needs the files looked up, which are few
+ * and change as lookups finish, so they are all sorted every time. */
+static guint32 *get_sorted_files(struct PLUGIN_DATA *plugin_data, guint *count)
+{
+	const guint32 *rows;
+	GArray *ids;
+
+	if(is_file_info_key(plugin_data->sort_key))
+	{
+		ids = query_result_get_ids(plugin_data->query_result, file_index->count);
+		g_qsort_with_data(ids->data, ids->len, sizeof(guint32), compare_file_ids, plugin_data);
+		*count = MIN(ids->len, FILE_LIST_MAX_ROWS);
+		return (guint32*)g_array_free(ids, FALSE);
+	}
+
+	rows = query_result_get_rows(plugin_data->query_result, plugin_data->sort_key,
+		plugin_data->sort_order == GTK_SORT_DESCENDING, count);
+	return g_memdup(rows, MAX(*count, 1) * sizeof(guint32));
+}
+
+
+/**********************************************************************/
+/* Lists the first files of the query result in the order of the sort
+ * column. The view gets a new model holding just their ids, so no
+ * filter or sort callbacks run per row and the cost does not grow with
+ * the number of matches beyond FILE_LIST_MAX_ROWS. The cursor goes to
+ * cursor_id if it is listed, else to the first row. */
+static void fill_file_list(struct PLUGIN_DATA *plugin_data, gint cursor_id, gboolean keep_selection)
+{
+	guint matched = plugin_data->query_result != NULL ? plugin_data->query_result->count : (file_index != NULL ? file_index->count : 0);
+	GHashTable *selected = NULL;
+	GArray *selected_rows = g_array_new(FALSE, FALSE, sizeof(gint));
+	gint cursor_row = -1;
+	guint32 *ids;
+	guint count = 0;
+	guint i;
+
+	D(log_debug("%s:%s", __FILE__, __FUNCTION__));
+
+	if(keep_selection && gtk_tree_selection_count_selected_rows(plugin_data->selection) > 1)
+		selected = get_selected_ids(plugin_data);
+
+	/* Too many files to look up, which update_file_title notes */
+	if(is_file_info_key(plugin_data->sort_key) && matched > (guint)FILE_INFO_SORT_LIMIT)
+	{
+		plugin_data->sort_key = SORT_BY_NAME;
+		plugin_data->sort_order = GTK_SORT_ASCENDING;
+		update_sort_indicators(plugin_data);
+	}
+	ids = file_index != NULL ? get_sorted_files(plugin_data, &count) : g_new(guint32, 1);
+
+	for(i = 0; i < count; ++i)
+	{
+		if((gint)ids[i] == cursor_id)
+			cursor_row = i;
+		if(selected != NULL && g_hash_table_lookup(selected, GUINT_TO_POINTER(ids[i] + 1)) != NULL)
+			g_array_append_val(selected_rows, i);
+	}
+
+	plugin_data->model = file_list_model_new(ids, count);
+	gtk_tree_view_set_model(GTK_TREE_VIEW(plugin_data->tree_view), plugin_data->model);
+	g_object_unref(plugin_data->model);
+
+	if(cursor_row >= 0)
+	{
+		GtkTreePath *path = gtk_tree_path_new_from_indices(cursor_row, -1);
+		gtk_tree_view_set_cursor(GTK_TREE_VIEW(plugin_data->tree_view), path, NULL, FALSE);
+		gtk_tree_path_free(path);
+	}
+	else
+		select_first_row(plugin_data);
+
+	/* Setting the cursor selects only its row */
+	for(i = 0; i < selected_rows->len; ++i)
+	{
+		GtkTreePath *path = gtk_tree_path_new_from_indices(g_array_index(selected_rows, gint, i), -1);
+		gtk_tree_selection_select_path(plugin_data->selection, path);
+		gtk_tree_path_free(path);
+	}
+
+	if(selected != NULL)
+		g_hash_table_destroy(selected);
+	g_array_free(selected_rows, TRUE);
+}
+
+
+/**********************************************************************/
+/* Shows looked up file information. A list sorted by it is sorted again,
+ * the rows are not changed one by one. */
+static void file_info_changed(struct PLUGIN_DATA *plugin_data)
+{
+	if(is_file_info_key(plugin_data->sort_key))
+		fill_file_list(plugin_data, get_cursor_id(plugin_data), TRUE);
+	else
+		gtk_widget_queue_draw(plugin_data->tree_view);
+}
+
+
+/**********************************************************************/
+static gboolean on_file_info_drain(G_GNUC_UNUSED gpointer data)
+{
+	FileInfoTask *task;
+	gboolean changed = FALSE;
+	guint i;
+
+	while((task = g_async_queue_try_pop(file_info_results)) != NULL)
+	{
+		/* Lookups still running when the plugin was unloaded are not counted */
+		if(task->load != plugin_load)
+		{
+			file_info_task_free(task);
+			continue;
+		}
+		if(file_info_tasks > 0)
+			file_info_tasks--;
+
+		/* The ids of a replaced index mean other files in the current one */
+		if(file_index != NULL && file_index->serial == task->serial)
+		{
+			for(i = 0; i < task->count; ++i)
+			{
+				FileInfo *info = &file_index->infos[task->ids[i]];
+				*info = task->infos[i];
+				info->session = task->session;
+			}
+			changed = TRUE;
+		}
+		file_info_task_free(task);
+	}
+
+	if(changed && open_dialog != NULL)
+		file_info_changed(open_dialog);
+
+	if(file_info_tasks > 0)
+		return TRUE;
+
+	file_info_drain_id = 0;
+	return FALSE;
+}
+
+
+/**********************************************************************/
+static void push_file_info_task(FileInfoTask *task)
+{
+	task->infos = g_new0(FileInfo, task->count);
+	task->load = plugin_load;
+	if(file_info_results == NULL)
+		file_info_results = g_async_queue_new();
+	file_info_tasks++;
+	worker_pool_push(file_info_worker, task);
+	if(file_info_drain_id == 0)
+		file_info_drain_id = g_timeout_add(FILE_INFO_DRAIN_INTERVAL, on_file_info_drain, NULL);
+}
+
+
+/**********************************************************************/
+/* Looks up the files that were not looked up since the dialog was
+ * opened, in batches on the workers */
+static void request_file_info(GArray *ids)
+{
+	FileInfoTask *task = NULL;
+	IndexCursor cursor;
+	guint i;
+
+	if(file_index == NULL || ids->len == 0)
+		return;
+
+	if(file_index->infos == NULL)
+		file_index->infos = g_new0(FileInfo, MAX(file_index->count, 1));
+
+	g_array_sort(ids, compare_ids);
+	index_cursor_init(&cursor, file_index, 0);
+	for(i = 0; i < ids->len; ++i)
+	{
+		guint32 id = g_array_index(ids, guint32, i);
+		FileInfo *info = &file_index->infos[id];
+
+		if(info->pending || info->session == file_info_session)
+			continue;
+
+		/* Decode from the block of the entry unless the last one was in it */
+		if(id / INDEX_BLOCK_SIZE > cursor.next_id / INDEX_BLOCK_SIZE)
+			index_cursor_seek(&cursor, id / INDEX_BLOCK_SIZE);
+		while(cursor.next_id <= id)
+			index_cursor_next(&cursor);
+
+		/* Files of an earlier index keep what was looked up for them */
+		if(info->session == 0 && file_info_source != NULL)
+		{
+			gint source_id = file_index_find(file_info_source, cursor.path->str);
+			if(source_id >= 0 && file_info_source->infos[source_id].session != 0)
+			{
+				*info = file_info_source->infos[source_id];
+				info->pending = FALSE;
+				if(info->session == file_info_session)
+					continue;
+			}
+		}
+		info->pending = TRUE;
+
+		if(task == NULL)
+		{
+			task = g_malloc0(sizeof(FileInfoTask));
+			task->serial = file_index->serial;
+			task->session = file_info_session;
+			task->ids = g_new(guint32, FILE_INFO_BATCH);
+			task->paths = g_new0(gchar*, FILE_INFO_BATCH + 1);
+		}
+		task->ids[task->count] = id;
+		task->paths[task->count] = g_strndup(cursor.path->str, cursor.path->len);
+		if(++task->count == FILE_INFO_BATCH)
+		{
+			push_file_info_task(task);
+			task = NULL;
+		}
+	}
+	index_cursor_clear(&cursor);
+
+	if(task != NULL)
+		push_file_info_task(task);
+}
+
+
+/**********************************************************************/
+/* Requests the file information of the rows in view, or of all listed
+ * files when the list is sorted by it */
+static void request_view_file_info(struct PLUGIN_DATA *plugin_data)
+{
+	GArray *ids = g_array_new(FALSE, FALSE, sizeof(guint32));
+	GtkTreePath *start;
+	GtkTreePath *end;
+	GtkTreeIter iter;
+	guint id;
+
+	/* The list shows only the first files, all of them are sorted */
+	if(is_file_info_key(plugin_data->sort_key))
+	{
+		g_array_free(ids, TRUE);
+		ids = query_result_get_ids(plugin_data->query_result, file_index != NULL ? file_index->count : 0);
+	}
+	else if(gtk_tree_view_get_visible_range(GTK_TREE_VIEW(plugin_data->tree_view), &start, &end))
+	{
+		gint rows = gtk_tree_path_get_indices(end)[0] - gtk_tree_path_get_indices(start)[0] + 1;
+		gboolean valid = gtk_tree_model_get_iter(plugin_data->model, &iter, start);
+		for(; valid && rows > 0; --rows)
+		{
+			id = get_row_id(plugin_data->model, &iter);
+			g_array_append_val(ids, id);
+			valid = gtk_tree_model_iter_next(plugin_data->model, &iter);
+		}
+		gtk_tree_path_free(start);
+		gtk_tree_path_free(end);
+	}
+
+	request_file_info(ids);
+	g_array_free(ids, TRUE);
+}
+
+
+/**********************************************************************/
+static gboolean on_file_info_idle(gpointer data)
+{
+	struct PLUGIN_DATA *plugin_data = data;
+
+	plugin_data->file_info_idle_id = 0;
+	request_view_file_info(plugin_data);
+
+	return FALSE;
+}
+
+
+/**********************************************************************/
+/* Requests the file information once the list is laid out, after it was
+ * scrolled, resized, filtered or sorted */
+static void schedule_file_info(struct PLUGIN_DATA *plugin_data)
+{
+	if(show_file_details && open_dialog == plugin_data && plugin_data->file_info_idle_id == 0)
+		plugin_data->file_info_idle_id = g_idle_add(on_file_info_idle, plugin_data);
+}
+
+
+/**********************************************************************/
+static void on_file_list_changed(G_GNUC_UNUSED gpointer object, struct PLUGIN_DATA *plugin_data)
+{
+	schedule_file_info(plugin_data);
+}
+
+
+/**********************************************************************/
+static int on_update_visibilty_elements(G_GNUC_UNUSED GtkWidget *widget, struct PLUGIN_DATA *plugin_data)
+{
+	D(log_debug("%s:%s", __FILE__, __FUNCTION__));
+
+	plugin_data->text_value = gtk_entry_get_text(GTK_ENTRY(plugin_data->text_entry));
+	update_query_result(plugin_data);
+
+	fill_file_list(plugin_data, -1, FALSE);
+	schedule_file_info(plugin_data);
+
+	update_file_title(plugin_data);
+
+	return 0;
+}
+
+
+/**********************************************************************/
+static void content_match_free(ContentMatch *match)
+{
+	g_free(match->text);
+	g_free(match);
+}
+
+
+/**********************************************************************/
+static void content_search_unref(ContentSearch *search)
+{
+	if(!g_atomic_int_dec_and_test(&search->ref_count))
+		return;
+
+	g_ptr_array_unref(search->files);
+	g_free(search->needle);
+	if(search->regex != NULL)
+		g_regex_unref(search->regex);
+	g_async_queue_unref(search->results);
+	g_free(search);
+}
+
+
+/**********************************************************************/
+static gboolean has_upper_case(const gchar *text, gboolean regex)
+{
+	for(; *text != '\0'; text++)
+	{
+		if(regex && *text == '\\' && text[1] != '\0')
+			text++;
+		else if(g_ascii_isupper(*text))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+
+/**********************************************************************/
+/* Returns the longest run of plain characters that every match of the
+ * regular expression contains, or an empty string if there is none.
+ * Groups, classes and alternations are not looked into. */
+static gchar *literal_from_regex(const gchar *pattern)
+{
+	const gchar *p;
+	const gchar *run = NULL;
+	const gchar *best = pattern;
+	gsize best_len = 0;
+	gint depth = 0;
+
+	if(strchr(pattern, '|') != NULL || strstr(pattern, "(?") != NULL)
+		return g_strdup("");
+
+	for(p = pattern; ; p++)
+	{
+		if(depth == 0 && *p != '\0' && (g_ascii_isalnum(*p) || strchr(" _-/<>=:;,'\"#%&@~!", *p) != NULL))
+		{
+			if(run == NULL)
+				run = p;
+			continue;
+		}
+
+		if(run != NULL)
+		{
+			/* A quantifier makes the last character of the run optional */
+			gsize len = p - run;
+			if(*p == '?' || *p == '*' || *p == '{')
+				len--;
+			if(len > best_len)
+			{
+				best = run;
+				best_len = len;
+			}
+			run = NULL;
+		}
+
+		if(*p == '\0')
+			break;
+		else if(*p == '\\' && p[1] != '\0')
+		{
+			/* Other escapes such as \x41, \101 or \k<name> stand for text
+			 * that is not written out, no literal is safe then */
+			if(!g_ascii_ispunct(p[1]) && strchr("dDwWsSbB", p[1]) == NULL)
+				return g_strdup("");
+			p++;
+		}
+		else if(*p == '(')
+			depth++;
+		else if(*p == ')' && depth > 0)
+			depth--;
+		else if(*p == '{')
+		{
+			for(p++; *p != '\0' && *p != '}'; p++)
+			{
+				if(*p == '\\' && p[1] != '\0')
+					p++;
+			}
+			if(*p == '\0')
+				break;
+		}
+		else if(*p == '[')
+		{
+			/* A ']' right after "[" or "[^" is part of the class, as is the
+			 * one closing a POSIX class like "[:alpha:]" */
+			p++;
+			if(*p == '^')
+				p++;
+			if(*p == ']')
+				p++;
+			for(; *p != '\0' && *p != ']'; p++)
+			{
+				if(*p == '\\' && p[1] != '\0')
+					p++;
+				else if(*p == '[' && p[1] == ':')
+				{
+					const gchar *end = strstr(p + 2, ":]");
+					if(end != NULL)
+						p = end + 1;
+				}
+			}
+			if(*p == '\0')
+				break;
+		}
+	}
+
+	return g_strndup(best, best_len);
+}
+
+
+/**********************************************************************/
+static ContentSearch *content_search_new(GPtrArray *files, const gchar *query, gboolean use_regex, GError **error)
+{
+	ContentSearch *search = g_malloc0(sizeof(ContentSearch));
+
+	search->ref_count = 1;
+	search->files = g_ptr_array_ref(files);
+	search->ignore_case = !has_upper_case(query, use_regex);
+	search->results = g_async_queue_new_full((GDestroyNotify)content_match_free);
+
+	if(use_regex)
+	{
+		search->regex = g_regex_new(query, search->ignore_case ? G_REGEX_CASELESS | G_REGEX_OPTIMIZE : G_REGEX_OPTIMIZE, 0, error);
+		if(search->regex == NULL)
+		{
+			content_search_unref(search);
+			return NULL;
+		}
+		search->needle = literal_from_regex(query);
+
+		/* Folding only ASCII letters could skip lines the regex matches */
+		if(search->ignore_case)
+		{
+			const gchar *c = search->needle;
+			while(*c != '\0' && !(*c & 0x80))
+				c++;
+			if(*c != '\0')
+				search->needle[0] = '\0';
+		}
+	}
+	else
+		search->needle = g_strdup(query);
+
+	if(search->ignore_case)
+	{
+		gchar *folded = g_ascii_strdown(search->needle, -1);
+		g_free(search->needle);
+		search->needle = folded;
+	}
+	search->needle_len = strlen(search->needle);
+
+	return search;
+}
+
+
+/**********************************************************************/
+static const gchar *find_byte(const gchar *from, const gchar *end, guchar c)
+{
+	const gchar *found = memchr(from, c, end - from);
+
+	return found != NULL ? found : end;
+}
+
+
+/**********************************************************************/
+/* Finds the next occurrence of the search literal at or after from.
+ * The next position of each case variant of the first byte is kept in
+ * next between calls, so memchr never scans the same bytes twice. */
+static const gchar *find_literal(const ContentSearch *search, const gchar **next, const gchar *from, const gchar *end)
+{
+	const guchar first = search->needle[0];
+	const guchar first_upper = search->ignore_case ? g_ascii_toupper(first) : first;
+
+	for(;;)
+	{
+		const gchar *candidate;
+
+		if(next[0] == NULL || next[0] < from)
+			next[0] = find_byte(from, end, first);
+		if(next[1] == NULL || next[1] < from)
+			next[1] = first_upper == first ? next[0] : find_byte(from, end, first_upper);
+
+		candidate = MIN(next[0], next[1]);
+		if((gsize)(end - candidate) < search->needle_len)
+			return NULL;
+
+		if(search->ignore_case ?
+			 g_ascii_strncasecmp(candidate, search->needle, search->needle_len) == 0 :
+			 memcmp(candidate, search->needle, search->needle_len) == 0)
+			return candidate;
+
+		from = candidate + 1;
+	}
+}
+
+
+/**********************************************************************/
+static void add_content_match(ContentSearch *search, guint file, gint line, const gchar *start, const gchar *end)
+{
+	ContentMatch *match;
+	const gchar *valid_end;
+
+	while(start < end && g_ascii_isspace(*start))
+		start++;
+	while(end > start && g_ascii_isspace(end[-1]))
+		end--;
+	if((gsize)(end - start) > CONTENT_MAX_TEXT)
+		end = start + CONTENT_MAX_TEXT;
+	g_utf8_validate(start, end - start, &valid_end);
+
+	match = g_malloc(sizeof(ContentMatch));
+	match->file = file;
+	match->line = line;
+	match->text = g_strndup(start, valid_end - start);
+	g_async_queue_push(search->results, match);
+
+	if(g_atomic_int_add(&search->match_count, 1) + 1 >= CONTENT_MAX_MATCHES)
+		g_atomic_int_set(&search->cancelled, TRUE);
+}
+
+
+/**********************************************************************/
+/* Searches lines of a file, the first of which is line. Afterwards line
+ * is the number of the line that follows them. */
+static void search_buffer(ContentSearch *search, guint file, const gchar *data, gsize length, gint *line)
+{
+	const gchar *end = data + length;
+	const gchar *pos = data;      /* start of the first line not yet searched */
+	const gchar *counted = data;  /* newlines before this are counted in line */
+	const gchar *next[2] = { NULL, NULL };
+	const gchar *newline;
+
+	while(pos < end && !g_atomic_int_get(&search->cancelled))
+	{
+		const gchar *hit = search->needle_len > 0 ? find_literal(search, next, pos, end) : pos;
+		const gchar *line_start;
+		const gchar *line_end;
+
+		if(hit == NULL)
+			break;
+
+		line_start = hit;
+		while(line_start > pos && line_start[-1] != '\n')
+			line_start--;
+		line_end = memchr(hit, '\n', end - hit);
+		if(line_end == NULL)
+			line_end = end;
+
+		while((newline = memchr(counted, '\n', line_start - counted)) != NULL)
+		{
+			(*line)++;
+			counted = newline + 1;
+		}
+		counted = line_start;
+
+		/* GRegex requires valid UTF-8, lines in other encodings are only
+		 * found by literal searches */
+		if(search->regex == NULL ||
+		   (g_utf8_validate(line_start, line_end - line_start, NULL) &&
+		    g_regex_match_full(search->regex, line_start, line_end - line_start, 0, 0, NULL, NULL)))
+			add_content_match(search, file, *line, line_start, line_end);
+
+		pos = line_end + 1;
+	}
+
+	while(counted < end && (newline = memchr(counted, '\n', end - counted)) != NULL)
+	{
+		(*line)++;
+		counted = newline + 1;
+	}
+}
+
+
+/**********************************************************************/
+/* Reads a file in chunks into the buffer of the worker and searches the
+ * complete lines of each chunk, the last partial line is carried over to
+ * the next one. Files are not mapped, a file truncated while it is read
+ * would crash Geany with SIGBUS. */
+static void search_file(ContentSearch *search, guint file, gchar **buffer, gsize *size)
+{
+	const gchar *file_name = g_ptr_array_index(search->files, file);
+	gsize length = 0;        /* bytes in buffer */
+	gboolean probed = FALSE;
+	gboolean done = FALSE;
+	gint line = 1;
+	int fd;
+
+#if defined (WIN32)
+	/* Never open fifos or devices, they could block the worker forever */
+	if(!g_file_test(file_name, G_FILE_TEST_IS_REGULAR))
+		return;
+	if((fd = g_open(file_name, O_RDONLY | O_BINARY, 0)) < 0)
+		return;
+#else
+	struct stat info;
+
+	/* Never read fifos or devices, they could block the worker forever */
+	if((fd = open(file_name, O_RDONLY | O_NONBLOCK | O_NOCTTY)) < 0)
+		return;
+	if(fstat(fd, &info) != 0 || !S_ISREG(info.st_mode))
+	{
+		close(fd);
+		return;
+	}
+#endif
+
+	while(!done && !g_atomic_int_get(&search->cancelled))
+	{
+		const gchar *line_end;
+		gsize complete;
+		gssize count;
+
+		/* A line longer than the buffer */
+		if(length == *size)
+		{
+			*size *= 2;
+			*buffer = g_realloc(*buffer, *size);
+		}
+
+		count = read(fd, *buffer + length, *size - length);
+		if(count > 0)
+			length += count;
+		else
+			done = TRUE;
+
+		if(!probed)
+		{
+			if(!done && length < CONTENT_BINARY_PROBE)
+				continue;
+			if(memchr(*buffer, '\0', MIN(length, CONTENT_BINARY_PROBE)) != NULL)
+				break;
+			probed = TRUE;
+		}
+
+		line_end = *buffer + length;
+		if(!done)
+		{
+			while(line_end > *buffer && line_end[-1] != '\n')
+				line_end--;
+		}
+		complete = line_end - *buffer;
+		if(complete == 0)
+			continue;
+
+		search_buffer(search, file, *buffer, complete, &line);
+		length -= complete;
+		memmove(*buffer, *buffer + complete, length);
+	}
+
+	close(fd);
+}
+
+
+/**********************************************************************/
+static void content_search_worker(gpointer data)
+{
+	ContentSearch *search = data;
+	gsize size = CONTENT_READ_SIZE;
+	gchar *buffer = g_malloc(size);
+	gint file;
+
+	while(!g_atomic_int_get(&search->cancelled) &&
+				(file = g_atomic_int_add(&search->next_file, 1)) < (gint)search->files->len)
+		search_file(search, file, &buffer, &size);
+
+	g_free(buffer);
+	g_atomic_int_add(&search->running, -1);
+	content_search_unref(search);
+}
+
+
+/**********************************************************************/
+/* Returns the full paths of the files selected by the location patterns */
+static GPtrArray *collect_files(void)
+{
+	GPtrArray *files = g_ptr_array_new_with_free_func(g_free);
+	IndexCursor cursor;
+	guint i = 0;
+
+	if(selected_file_count() == 0)
+		return files;
+
+	index_cursor_init(&cursor, file_index, 0);
+	while(index_cursor_next(&cursor))
+	{
+		if(location_selection != NULL)
+		{
+			if(i == location_selection->len)
+				break;
+			if(g_array_index(location_selection, guint32, i) != cursor.id)
+				continue;
+			i++;
+		}
+		g_ptr_array_add(files, g_strdup(cursor.path->str));
+	}
+	index_cursor_clear(&cursor);
+
+	return files;
+}
+
+
+/**********************************************************************/
+static gboolean in_content_mode(struct PLUGIN_DATA *plugin_data)
+{
+	return gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(plugin_data->content_check));
+}
+
+
+/**********************************************************************/
+static GtkWidget *current_view(struct PLUGIN_DATA *plugin_data)
+{
+	return in_content_mode(plugin_data) ? plugin_data->content_view : plugin_data->tree_view;
+}
+
+
+/**********************************************************************/
+static void cancel_content_search(struct PLUGIN_DATA *plugin_data)
+{
+	if(plugin_data->content_delay_id != 0)
+	{
+		g_source_remove(plugin_data->content_delay_id);
+		plugin_data->content_delay_id = 0;
+	}
+	if(plugin_data->content_drain_id != 0)
+	{
+		g_source_remove(plugin_data->content_drain_id);
+		plugin_data->content_drain_id = 0;
+	}
+	if(plugin_data->content_search != NULL)
+	{
+		g_atomic_int_set(&plugin_data->content_search->cancelled, TRUE);
+		content_search_unref(plugin_data->content_search);
+		plugin_data->content_search = NULL;
+	}
+}
+
+
+/**********************************************************************/
+static gboolean on_content_drain(gpointer data)
+{
+	struct PLUGIN_DATA *plugin_data = data;
+	ContentSearch *search = plugin_data->content_search;
+	ContentMatch *match;
+
+	/* Read before draining, everything pushed before the last worker
+	 * stopped is then guaranteed to be in the queue */
+	gboolean finished = g_atomic_int_get(&search->running) == 0;
+
+	while((match = g_async_queue_try_pop(search->results)) != NULL)
+	{
+		const gchar *file_name = g_ptr_array_index(search->files, match->file);
+		gchar *short_name = g_path_get_basename(file_name);
+		gchar *path = g_path_get_dirname(file_name);
+
+		gtk_list_store_insert_with_values(plugin_data->content_store, NULL, -1,
+			COLUMN_CONTENT_SHORT_NAME, short_name,
+			COLUMN_CONTENT_PATH, path,
+			COLUMN_CONTENT_LINE, match->line,
+			COLUMN_CONTENT_TEXT, match->text,
+			-1);
+		if(plugin_data->content_rows++ == 0)
+		{
+			GtkTreePath *tree_path = gtk_tree_path_new_from_indices(0, -1);
+			gtk_tree_view_set_cursor(GTK_TREE_VIEW(plugin_data->content_view), tree_path, NULL, FALSE);
+			gtk_tree_path_free(tree_path);
+			gtk_widget_set_sensitive(plugin_data->open_button, TRUE);
+		}
+
+		g_free(short_name);
+		g_free(path);
+		content_match_free(match);
+	}
+
+	if(!finished)
+	{
+		set_title(plugin_data, "%d matches, searching...", plugin_data->content_rows);
+		return TRUE;
+	}
+
+	if(plugin_data->content_rows >= CONTENT_MAX_MATCHES)
+		set_title(plugin_data, "%d matches (limit reached)", plugin_data->content_rows);
+	else
+		set_title(plugin_data, "%d matches", plugin_data->content_rows);
+	plugin_data->content_drain_id = 0;
+
+	return FALSE;
+}
+
+
+/**********************************************************************/
+static void start_content_search(struct PLUGIN_DATA *plugin_data)
+{
+	const gchar *query = gtk_entry_get_text(GTK_ENTRY(plugin_data->text_entry));
+	gboolean use_regex = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(plugin_data->regex_check));
+	ContentSearch *search;
+	GError *error = NULL;
+	guint i;
+
+	D(log_debug("%s:%s - query: %s", __FILE__, __FUNCTION__, query));
+
+	cancel_content_search(plugin_data);
+	gtk_list_store_clear(plugin_data->content_store);
+	plugin_data->content_rows = 0;
+	gtk_widget_set_sensitive(plugin_data->open_button, FALSE);
+
+	if(query[0] == '\0')
+	{
+		gtk_window_set_title(GTK_WINDOW(plugin_data->main_window), PLUGIN_NAME);
+		return;
+	}
+
+	if(plugin_data->content_files == NULL)
+		plugin_data->content_files = collect_files();
+
+	if(!(search = content_search_new(plugin_data->content_files, query, use_regex, &error)))
+	{
+		set_title(plugin_data, "- %s", error->message);
+		g_error_free(error);
+		return;
+	}
+
+	plugin_data->content_search = search;
+	search->running = MIN(worker_count(), search->files->len);
+	for(i = 0; i < (guint)search->running; ++i)
+	{
+		g_atomic_int_inc(&search->ref_count);
+		worker_pool_push(content_search_worker, search);
 	}
-    clear_configuration(locations);
 
-	return GTK_TREE_MODEL(store);
+	plugin_data->content_drain_id = g_timeout_add(CONTENT_DRAIN_INTERVAL, on_content_drain, plugin_data);
 }
 
 
 /**********************************************************************/
-static gboolean count(G_GNUC_UNUSED GtkTreeModel *model,
-											G_GNUC_UNUSED GtkTreePath *path,
-											G_GNUC_UNUSED GtkTreeIter *iter,
-											gint *no_rows )
+static gboolean on_content_search_delay(gpointer data)
 {
-	(*no_rows)++;
+	struct PLUGIN_DATA *plugin_data = data;
+
+	plugin_data->content_delay_id = 0;
+	start_content_search(plugin_data);
 
 	return FALSE;
 }
 
 
 /**********************************************************************/
-void select_first_row(struct PLUGIN_DATA *plugin_data)
+static void schedule_content_search(struct PLUGIN_DATA *plugin_data)
 {
-	GtkTreePath *path = gtk_tree_path_new_from_indices(0, -1);
-	gtk_tree_view_set_cursor(GTK_TREE_VIEW(plugin_data->tree_view), path, NULL, FALSE);
-	gtk_tree_path_free(path);
+	/* Stop searching for the old text right away, but wait for a pause
+	 * in typing before starting on the new one */
+	cancel_content_search(plugin_data);
+	plugin_data->content_delay_id = g_timeout_add(CONTENT_SEARCH_DELAY, on_content_search_delay, plugin_data);
 }
 
 
 /**********************************************************************/
-static int on_update_visibilty_elements(G_GNUC_UNUSED GtkWidget *widget, struct PLUGIN_DATA *plugin_data)
+/* Asks the system to read a file ahead, so it is cached by the time
+ * Geany loads it */
+static void prefetch_file_worker(gpointer data)
 {
-	D(log_debug("%s:%s", __FILE__, __FUNCTION__));
-
-	plugin_data->text_value = gtk_entry_get_text(GTK_ENTRY(plugin_data->text_entry));
-
-	gtk_tree_model_filter_refilter(GTK_TREE_MODEL_FILTER(plugin_data->filter));
-
-	gint total_rows = 0;
-	gint filtered_rows = 0;
-	gtk_tree_model_foreach(plugin_data->model, (GtkTreeModelForeachFunc)count, &total_rows);
-	gtk_tree_model_foreach(plugin_data->filter, (GtkTreeModelForeachFunc)count, &filtered_rows);
-	gchar buf[20];
-	g_sprintf(buf, "%s %d/%d", PLUGIN_NAME, filtered_rows, total_rows);
-	gtk_window_set_title(GTK_WINDOW(plugin_data->main_window), buf);
-
-	select_first_row(plugin_data);
-
-	gtk_widget_set_sensitive(plugin_data->open_button, filtered_rows > 0);
-
-	return 0;
+#if !defined (WIN32) && defined (POSIX_FADV_WILLNEED)
+	/* Fifos and devices are in the index too, opening them must not block */
+	int fd = open(data, O_RDONLY | O_NONBLOCK | O_NOCTTY);
+	if(fd >= 0)
+	{
+		struct stat info;
+		if(fstat(fd, &info) == 0 && S_ISREG(info.st_mode))
+			posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+		close(fd);
+	}
+#endif
+	g_free(data);
 }
 
 
 /**********************************************************************/
-static gboolean row_visible(GtkTreeModel *model, GtkTreeIter *iter, gpointer data)
+/* Opens all selected files at once. They are read ahead on the workers
+ * while Geany creates the documents one after the other. */
+static void open_selected_files(struct PLUGIN_DATA *plugin_data)
 {
-	struct PLUGIN_DATA *plugin_data = data;
-	gchar *short_name;
-	gboolean visible = FALSE;
+	GtkTreeModel *model;
+	GList *rows = gtk_tree_selection_get_selected_rows(plugin_data->selection, &model);
+	GSList *files = NULL;
+	GSList *file;
+	GList *iter;
 
-	gtk_tree_model_get(model, iter, COLUMN_OPEN_FILE_SHORT_NAME, &short_name, -1);
-	const gchar *text_value = plugin_data->text_value;
+	D(log_debug("%s:%s", __FILE__, __FUNCTION__));
 
-	if (!text_value || g_strcmp0(text_value, "") == 0 || (short_name && g_str_match_string(text_value, short_name, TRUE)))
-		visible = TRUE;
+	for(iter = rows; iter != NULL; iter = iter->next)
+	{
+		GtkTreeIter tree_iter;
+		if(file_index != NULL && gtk_tree_model_get_iter(model, &tree_iter, iter->data))
+			files = g_slist_prepend(files, file_index_get_path(file_index, get_row_id(model, &tree_iter), NULL));
+		gtk_tree_path_free(iter->data);
+	}
+	g_list_free(rows);
+	files = g_slist_reverse(files);
 
-	g_free(short_name);
+	for(file = files; file != NULL; file = file->next)
+		worker_pool_push(prefetch_file_worker, g_strdup(file->data));
+	document_open_files(files, FALSE, NULL, NULL);
 
-	return visible;
+	for(file = files; file != NULL; file = file->next)
+		g_free(file->data);
+	g_slist_free(files);
 }
 
 
@@ -327,24 +4389,43 @@ void activate_selected_file_and_quit(struct PLUGIN_DATA *plugin_data)
 
 	D(log_debug("%s:%s", __FILE__, __FUNCTION__));
 
-	gtk_tree_view_get_cursor(GTK_TREE_VIEW(plugin_data->tree_view), &tree_path, NULL);
+	GtkWidget *view = current_view(plugin_data);
+	if(view == plugin_data->tree_view)
+	{
+		if(gtk_tree_selection_count_selected_rows(plugin_data->selection) > 1)
+			open_selected_files(plugin_data);
+		else
+		{
+			gchar *full_path = get_cursor_file(plugin_data);
+			if(full_path != NULL)
+				document_open_file(full_path, FALSE, NULL, NULL);
+			g_free(full_path);
+		}
+	}
+	else
+		gtk_tree_view_get_cursor(GTK_TREE_VIEW(view), &tree_path, NULL);
 	if (tree_path)
 	{
 		GtkTreeIter iter;
-		GtkTreeModel *model = gtk_tree_view_get_model(GTK_TREE_VIEW(plugin_data->tree_view));
+		GtkTreeModel *model = gtk_tree_view_get_model(GTK_TREE_VIEW(view));
 		if (gtk_tree_model_get_iter(model, &iter, tree_path))
 		{
 			gchar *short_name = NULL;
 			gchar *path = NULL;
+			gint line = 0;
 			gtk_tree_model_get(model, &iter,
-				COLUMN_OPEN_FILE_SHORT_NAME, &short_name,
-				COLUMN_OPEN_FILE_PATH, &path,
+				COLUMN_CONTENT_SHORT_NAME, &short_name,
+				COLUMN_CONTENT_PATH, &path,
+				COLUMN_CONTENT_LINE, &line,
 				-1);
 
 			if(short_name != NULL && path != NULL)
 			{
 				gchar *full_path = g_build_filename(path, short_name, NULL);
-				document_open_file(full_path, FALSE, NULL, NULL);
+				GeanyDocument *old_doc = document_get_current();
+				GeanyDocument *doc = document_open_file(full_path, FALSE, NULL, NULL);
+				if(doc != NULL && line > 0)
+					navqueue_goto_line(old_doc, doc, line);
 				g_free(full_path);
 			}
 			g_free(short_name);
@@ -371,38 +4452,244 @@ void view_on_row_activated(G_GNUC_UNUSED GtkTreeView *treeview,
 
 
 /**********************************************************************/
-static void create_tree_view(struct PLUGIN_DATA *plugin_data)
+/* Returns the full path of a row. The name and path columns of a row are
+ * rendered one after the other, so it is only decoded once. */
+static const gchar *get_row_path(struct PLUGIN_DATA *plugin_data, GtkTreeModel *model, GtkTreeIter *iter, gsize *name_len)
+{
+	guint id = get_row_id(model, iter);
+
+	if(plugin_data->row_path == NULL || plugin_data->row_id != id || plugin_data->row_serial != file_index->serial)
+	{
+		g_free(plugin_data->row_path);
+		plugin_data->row_path = file_index_get_path(file_index, id, &plugin_data->row_name_len);
+		plugin_data->row_id = id;
+		plugin_data->row_serial = file_index->serial;
+	}
+	*name_len = plugin_data->row_name_len;
+
+	return plugin_data->row_path;
+}
+
+
+/**********************************************************************/
+static void render_file_name(G_GNUC_UNUSED GtkTreeViewColumn *column, GtkCellRenderer *renderer,
+                             GtkTreeModel *model, GtkTreeIter *iter, gpointer data)
+{
+	gsize name_len;
+	const gchar *path = get_row_path(data, model, iter, &name_len);
+
+	g_object_set(renderer, "text", path + strlen(path) - name_len, NULL);
+}
+
+
+/**********************************************************************/
+static void render_file_directory(G_GNUC_UNUSED GtkTreeViewColumn *column, GtkCellRenderer *renderer,
+                                  GtkTreeModel *model, GtkTreeIter *iter, gpointer data)
+{
+	gsize name_len;
+	const gchar *path = get_row_path(data, model, iter, &name_len);
+	gchar *directory = g_strndup(path, strlen(path) - name_len - 1);
+
+	g_object_set(renderer, "text", directory, NULL);
+	g_free(directory);
+}
+
+
+/**********************************************************************/
+/* Returns the looked up information of a row, NULL if there is none */
+static const FileInfo *get_row_file_info(GtkTreeModel *model, GtkTreeIter *iter)
+{
+	guint id;
+
+	if(file_index == NULL || file_index->infos == NULL)
+		return NULL;
+
+	id = get_row_id(model, iter);
+	if(file_index->infos[id].session == 0 || file_index->infos[id].size < 0)
+		return NULL;
+
+	return &file_index->infos[id];
+}
+
+
+/**********************************************************************/
+static void render_file_size(G_GNUC_UNUSED GtkTreeViewColumn *column, GtkCellRenderer *renderer,
+                             GtkTreeModel *model, GtkTreeIter *iter, G_GNUC_UNUSED gpointer data)
+{
+	const FileInfo *info = get_row_file_info(model, iter);
+	gchar *text = info != NULL ? g_format_size(info->size) : NULL;
+
+	g_object_set(renderer, "text", text, NULL);
+	g_free(text);
+}
+
+
+/**********************************************************************/
+static void render_file_modified(G_GNUC_UNUSED GtkTreeViewColumn *column, GtkCellRenderer *renderer,
+                                 GtkTreeModel *model, GtkTreeIter *iter, G_GNUC_UNUSED gpointer data)
+{
+	const FileInfo *info = get_row_file_info(model, iter);
+	gchar *text = NULL;
+
+	if(info != NULL)
+	{
+		GDateTime *time = g_date_time_new_from_unix_local(info->mtime);
+		if(time != NULL)
+		{
+			text = g_date_time_format(time, "%Y-%m-%d %H:%M");
+			g_date_time_unref(time);
+		}
+	}
+
+	g_object_set(renderer, "text", text, NULL);
+	g_free(text);
+}
+
+
+/**********************************************************************/
+/* Fills the file list from a new index, keeping the cursor on the file
+ * at it before, selected_file */
+static void set_file_model(struct PLUGIN_DATA *plugin_data, const gchar *selected_file)
 {
-	GtkTreeViewColumn *filename_column;
-	GtkTreeViewColumn *path_column;
+	gint id = selected_file != NULL && file_index != NULL ? file_index_find(file_index, selected_file) : -1;
 
 	D(log_debug("%s:%s", __FILE__, __FUNCTION__));
 
-	plugin_data->model = get_files();
+	/* The ids of the old query result refer to the previous index */
+	update_query_result(plugin_data);
+	fill_file_list(plugin_data, id, FALSE);
+	schedule_file_info(plugin_data);
+
+	/* Content searches use the files of the new index from now on */
+	if(plugin_data->content_files != NULL)
+	{
+		g_ptr_array_unref(plugin_data->content_files);
+		plugin_data->content_files = NULL;
+	}
+}
+
+
+/**********************************************************************/
+/* Sorts the file list by the clicked column, or the other way round if
+ * it is sorted by it already */
+static void on_file_column_clicked(GtkTreeViewColumn *column, struct PLUGIN_DATA *plugin_data)
+{
+	SortKey key = SORT_BY_NAME;
+
+	while(key + 1 < SORT_KEY_COUNT && get_sort_column(plugin_data, key) != column)
+		key++;
+
+	if(key == plugin_data->sort_key)
+		plugin_data->sort_order = plugin_data->sort_order == GTK_SORT_ASCENDING ? GTK_SORT_DESCENDING : GTK_SORT_ASCENDING;
+	else
+	{
+		plugin_data->sort_key = key;
+		plugin_data->sort_order = GTK_SORT_ASCENDING;
+	}
+	update_sort_indicators(plugin_data);
+
+	fill_file_list(plugin_data, get_cursor_id(plugin_data), TRUE);
+	schedule_file_info(plugin_data);
+}
+
+
+/**********************************************************************/
+/* Adds a column of the file list. All rows have the same height and the
+ * columns a fixed width, so only the rows in view are rendered. */
+static GtkTreeViewColumn *add_file_column(struct PLUGIN_DATA *plugin_data, const gchar *title, GtkCellRenderer *renderer,
+                                          GtkTreeCellDataFunc func, gint width)
+{
+	GtkTreeViewColumn *column = gtk_tree_view_column_new_with_attributes(title, renderer, NULL);
+
+	gtk_tree_view_column_set_cell_data_func(column, renderer, func, plugin_data, NULL);
+	gtk_tree_view_column_set_sizing(column, GTK_TREE_VIEW_COLUMN_FIXED);
+	gtk_tree_view_column_set_fixed_width(column, width);
+	gtk_tree_view_column_set_resizable(column, TRUE);
+	gtk_tree_view_column_set_clickable(column, TRUE);
+	g_signal_connect(column, "clicked", G_CALLBACK(on_file_column_clicked), plugin_data);
+	gtk_tree_view_append_column(GTK_TREE_VIEW(plugin_data->tree_view), column);
+
+	return column;
+}
+
 
-	plugin_data->filter = gtk_tree_model_filter_new(plugin_data->model, NULL);
-	gtk_tree_model_filter_set_visible_func(GTK_TREE_MODEL_FILTER(plugin_data->filter), row_visible, plugin_data, NULL);
+/**********************************************************************/
+static void create_tree_view(struct PLUGIN_DATA *plugin_data)
+{
+	GtkCellRenderer *renderer;
 
-	plugin_data->sorted = gtk_tree_model_sort_new_with_model(plugin_data->filter);
+	D(log_debug("%s:%s", __FILE__, __FUNCTION__));
 
-	plugin_data->tree_view = gtk_tree_view_new_with_model(plugin_data->sorted);
+	/* Filled when the dialog is shown */
+	plugin_data->model = file_list_model_new(g_new(guint32, 1), 0);
+	plugin_data->tree_view = gtk_tree_view_new_with_model(plugin_data->model);
+	g_object_unref(plugin_data->model);
+	plugin_data->selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(plugin_data->tree_view));
+	gtk_tree_selection_set_mode(plugin_data->selection, GTK_SELECTION_MULTIPLE);
 	g_signal_connect(plugin_data->tree_view, "row-activated", (GCallback) view_on_row_activated, plugin_data);
 
-	GtkCellRenderer *renderer = gtk_cell_renderer_text_new();
-	gtk_tree_view_insert_column_with_attributes(GTK_TREE_VIEW(plugin_data->tree_view ), -1, "File name", renderer, "text", COLUMN_OPEN_FILE_SHORT_NAME, NULL);
-	filename_column = gtk_tree_view_get_column(GTK_TREE_VIEW(plugin_data->tree_view ), COLUMN_OPEN_FILE_SHORT_NAME);
-	gtk_tree_view_column_set_sort_column_id(filename_column, COLUMN_OPEN_FILE_SHORT_NAME);
-	gtk_tree_view_column_set_max_width(filename_column, WINDOW_WIDTH * 2 / 3);
+	renderer = gtk_cell_renderer_text_new();
+	g_object_set(renderer, "ellipsize", PANGO_ELLIPSIZE_END, NULL);
+	plugin_data->name_column = add_file_column(plugin_data, "File name", renderer, render_file_name, WINDOW_WIDTH / 3);
 
 	renderer = gtk_cell_renderer_text_new();
 	g_object_set(renderer, "ellipsize", PANGO_ELLIPSIZE_MIDDLE, NULL);
-	gtk_tree_view_insert_column_with_attributes(GTK_TREE_VIEW(plugin_data->tree_view ), -1, "Path", renderer, "text", COLUMN_OPEN_FILE_PATH, NULL);
-	path_column = gtk_tree_view_get_column(GTK_TREE_VIEW(plugin_data->tree_view ), COLUMN_OPEN_FILE_PATH);
-	gtk_tree_view_column_set_sort_column_id(path_column, COLUMN_OPEN_FILE_PATH);
-	gtk_tree_view_column_set_max_width(path_column, WINDOW_WIDTH * 2 / 3);
+	plugin_data->path_column = add_file_column(plugin_data, "Path", renderer, render_file_directory, WINDOW_WIDTH / 3);
+	gtk_tree_view_column_set_expand(plugin_data->path_column, TRUE);
+
+	/* Filled from the file information of the rows in view */
+	renderer = gtk_cell_renderer_text_new();
+	g_object_set(renderer, "xalign", 1.0, NULL);
+	plugin_data->size_column = add_file_column(plugin_data, "Size", renderer, render_file_size, WINDOW_WIDTH / 8);
+	gtk_tree_view_column_set_visible(plugin_data->size_column, show_file_details);
+
+	renderer = gtk_cell_renderer_text_new();
+	plugin_data->modified_column = add_file_column(plugin_data, "Modified", renderer, render_file_modified, WINDOW_WIDTH / 5);
+	gtk_tree_view_column_set_visible(plugin_data->modified_column, show_file_details);
+
+	gtk_tree_view_set_fixed_height_mode(GTK_TREE_VIEW(plugin_data->tree_view), TRUE);
+	update_sort_indicators(plugin_data);
+}
+
+
+/**********************************************************************/
+static void create_content_view(struct PLUGIN_DATA *plugin_data)
+{
+	GtkTreeViewColumn *column;
+	GtkCellRenderer *renderer;
+
+	D(log_debug("%s:%s", __FILE__, __FUNCTION__));
+
+	plugin_data->content_store = gtk_list_store_new(CONTENT_COLUMN_COUNT,
+																									G_TYPE_STRING,
+																									G_TYPE_STRING,
+																									G_TYPE_INT,
+																									G_TYPE_STRING);
+
+	plugin_data->content_view = gtk_tree_view_new_with_model(GTK_TREE_MODEL(plugin_data->content_store));
+	g_object_unref(plugin_data->content_store);
+	g_signal_connect(plugin_data->content_view, "row-activated", (GCallback) view_on_row_activated, plugin_data);
 
-	/* Trigger a sort */
-	gtk_tree_view_column_clicked(filename_column);
+	renderer = gtk_cell_renderer_text_new();
+	column = gtk_tree_view_column_new_with_attributes("File name", renderer, "text", COLUMN_CONTENT_SHORT_NAME, NULL);
+	gtk_tree_view_column_set_max_width(column, WINDOW_WIDTH / 3);
+	gtk_tree_view_append_column(GTK_TREE_VIEW(plugin_data->content_view), column);
+
+	renderer = gtk_cell_renderer_text_new();
+	column = gtk_tree_view_column_new_with_attributes("Line", renderer, "text", COLUMN_CONTENT_LINE, NULL);
+	gtk_tree_view_append_column(GTK_TREE_VIEW(plugin_data->content_view), column);
+
+	renderer = gtk_cell_renderer_text_new();
+	g_object_set(renderer, "ellipsize", PANGO_ELLIPSIZE_END, NULL);
+	column = gtk_tree_view_column_new_with_attributes("Text", renderer, "text", COLUMN_CONTENT_TEXT, NULL);
+	gtk_tree_view_column_set_expand(column, TRUE);
+	gtk_tree_view_append_column(GTK_TREE_VIEW(plugin_data->content_view), column);
+
+	renderer = gtk_cell_renderer_text_new();
+	g_object_set(renderer, "ellipsize", PANGO_ELLIPSIZE_MIDDLE, NULL);
+	column = gtk_tree_view_column_new_with_attributes("Path", renderer, "text", COLUMN_CONTENT_PATH, NULL);
+	gtk_tree_view_column_set_max_width(column, WINDOW_WIDTH / 3);
+	gtk_tree_view_append_column(GTK_TREE_VIEW(plugin_data->content_view), column);
 }
 
 
@@ -432,7 +4719,7 @@ static gboolean on_key_press(G_GNUC_UNUSED GtkWidget *widget,
 		close_plugin(plugin_data);
 		break;
 	case 0xff54: /* GDK_Down */
-		gtk_widget_grab_focus(plugin_data->tree_view);
+		gtk_widget_grab_focus(current_view(plugin_data));
 		break;
 	default:
 		return FALSE;
@@ -456,6 +4743,87 @@ static void on_open_button(G_GNUC_UNUSED GtkButton *button, struct PLUGIN_DATA *
 }
 
 
+/**********************************************************************/
+static void on_text_changed(GtkWidget *widget, struct PLUGIN_DATA *plugin_data)
+{
+	if(in_content_mode(plugin_data))
+		schedule_content_search(plugin_data);
+	else
+		on_update_visibilty_elements(widget, plugin_data);
+}
+
+
+/**********************************************************************/
+static void on_content_toggled(GtkToggleButton *button, struct PLUGIN_DATA *plugin_data)
+{
+	gboolean content = gtk_toggle_button_get_active(button);
+
+	D(log_debug("%s:%s", __FILE__, __FUNCTION__));
+
+	gtk_widget_set_visible(plugin_data->file_list_window, !content);
+	gtk_widget_set_visible(plugin_data->content_list_window, content);
+	gtk_widget_set_sensitive(plugin_data->regex_check, content);
+
+	if(content)
+	{
+		start_content_search(plugin_data);
+	}
+	else
+	{
+		cancel_content_search(plugin_data);
+		on_update_visibilty_elements(plugin_data->text_entry, plugin_data);
+	}
+	gtk_widget_grab_focus(plugin_data->text_entry);
+}
+
+
+/**********************************************************************/
+static void on_details_toggled(GtkToggleButton *button, struct PLUGIN_DATA *plugin_data)
+{
+	show_file_details = gtk_toggle_button_get_active(button);
+	gtk_tree_view_column_set_visible(plugin_data->size_column, show_file_details);
+	gtk_tree_view_column_set_visible(plugin_data->modified_column, show_file_details);
+
+	if(!show_file_details && is_file_info_key(plugin_data->sort_key))
+	{
+		plugin_data->sort_key = SORT_BY_NAME;
+		plugin_data->sort_order = GTK_SORT_ASCENDING;
+		update_sort_indicators(plugin_data);
+		fill_file_list(plugin_data, get_cursor_id(plugin_data), TRUE);
+	}
+
+	if(!in_content_mode(plugin_data))
+		update_file_title(plugin_data);
+	schedule_file_info(plugin_data);
+	gtk_widget_grab_focus(plugin_data->text_entry);
+}
+
+
+/**********************************************************************/
+static void on_regex_toggled(G_GNUC_UNUSED GtkToggleButton *button, struct PLUGIN_DATA *plugin_data)
+{
+	if(in_content_mode(plugin_data))
+		start_content_search(plugin_data);
+	gtk_widget_grab_focus(plugin_data->text_entry);
+}
+
+
+/**********************************************************************/
+static void on_destroy(G_GNUC_UNUSED GtkWidget *widget, struct PLUGIN_DATA *plugin_data)
+{
+	D(log_debug("%s:%s", __FILE__, __FUNCTION__));
+
+	cancel_content_search(plugin_data);
+	if(plugin_data->content_files != NULL)
+		g_ptr_array_unref(plugin_data->content_files);
+	query_result_unref(plugin_data->query_result);
+	g_free(plugin_data->row_path);
+	if(plugin_data->file_info_idle_id != 0)
+		g_source_remove(plugin_data->file_info_idle_id);
+	open_dialog = NULL;
+}
+
+
 /**********************************************************************/
 static gboolean on_quit(G_GNUC_UNUSED GtkWidget *widget,
 											  G_GNUC_UNUSED GdkEvent *event,
@@ -479,7 +4847,11 @@ int launch_widget(void)
 	gtk_window_set_modal(GTK_WINDOW(plugin_data->main_window), TRUE);
 	gtk_container_set_border_width(GTK_CONTAINER(plugin_data->main_window), 5);
 
+	/* File information looked up before is shown but looked up again */
+	file_info_session++;
+
 	create_tree_view(plugin_data);
+	create_content_view(plugin_data);
 
 	GtkWidget *main_grid = gtk_table_new(2, 1, FALSE);
 
@@ -487,13 +4859,34 @@ int launch_widget(void)
 	gtk_table_set_col_spacings(GTK_TABLE(main_grid), 0);
 
 	plugin_data->text_entry = gtk_entry_new();
-	g_signal_connect(plugin_data->text_entry, "changed", G_CALLBACK(on_update_visibilty_elements), plugin_data);
+	g_signal_connect(plugin_data->text_entry, "changed", G_CALLBACK(on_text_changed), plugin_data);
 	gtk_table_attach(GTK_TABLE(main_grid), plugin_data->text_entry, 0, 1, 0, 1, GTK_EXPAND | GTK_FILL, GTK_SHRINK, 0, 0);
 
-	GtkWidget *scrolled_file_list_window = gtk_scrolled_window_new(NULL,NULL);
-	gtk_container_add(GTK_CONTAINER(scrolled_file_list_window), plugin_data->tree_view );
-	gtk_table_attach_defaults(GTK_TABLE(main_grid), scrolled_file_list_window, 0, 1, 1, 2);
-	gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled_file_list_window), GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+	GtkWidget *lists_box = gtk_vbox_new(FALSE, 0);
+	gtk_table_attach_defaults(GTK_TABLE(main_grid), lists_box, 0, 1, 1, 2);
+
+	plugin_data->file_list_window = gtk_scrolled_window_new(NULL,NULL);
+	gtk_container_add(GTK_CONTAINER(plugin_data->file_list_window), plugin_data->tree_view );
+	gtk_box_pack_start(GTK_BOX(lists_box), plugin_data->file_list_window, TRUE, TRUE, 0);
+	gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(plugin_data->file_list_window), GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+	GtkAdjustment *adjustment = gtk_scrolled_window_get_vadjustment(GTK_SCROLLED_WINDOW(plugin_data->file_list_window));
+	g_signal_connect(adjustment, "value-changed", G_CALLBACK(on_file_list_changed), plugin_data);
+	g_signal_connect(adjustment, "changed", G_CALLBACK(on_file_list_changed), plugin_data);
+
+	/* Content search results replace the file list while searching contents */
+	plugin_data->content_list_window = gtk_scrolled_window_new(NULL,NULL);
+	gtk_container_add(GTK_CONTAINER(plugin_data->content_list_window), plugin_data->content_view);
+	gtk_box_pack_start(GTK_BOX(lists_box), plugin_data->content_list_window, TRUE, TRUE, 0);
+	gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(plugin_data->content_list_window), GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+	gtk_widget_show_all(plugin_data->content_list_window);
+	gtk_widget_set_no_show_all(plugin_data->content_list_window, TRUE);
+	gtk_widget_hide(plugin_data->content_list_window);
+
+	/* Shows locations that could not be completely indexed */
+	plugin_data->status_label = gtk_label_new(NULL);
+	gtk_misc_set_alignment(GTK_MISC(plugin_data->status_label), 0, 0.5);
+	gtk_box_pack_start(GTK_BOX(lists_box), plugin_data->status_label, FALSE, FALSE, 4);
+	gtk_widget_set_no_show_all(plugin_data->status_label, TRUE);
 
 	gtk_window_set_title(GTK_WINDOW(plugin_data->main_window), PLUGIN_NAME);
 	gtk_widget_set_size_request(plugin_data->main_window, WINDOW_WIDTH, WINDOW_HEIGHT);
@@ -502,11 +4895,29 @@ int launch_widget(void)
 	gtk_window_set_transient_for(GTK_WINDOW(plugin_data->main_window), GTK_WINDOW (geany_plugin->geany_data->main_widgets->window));
 	g_signal_connect(plugin_data->main_window, "delete_event", G_CALLBACK(on_quit), plugin_data);
 	g_signal_connect(plugin_data->main_window, "key-press-event", G_CALLBACK(on_key_press), plugin_data);
+	g_signal_connect(plugin_data->main_window, "destroy", G_CALLBACK(on_destroy), plugin_data);
 
 	/* Buttons */
 	GtkWidget *bbox = gtk_hbutton_box_new();
 	gtk_button_box_set_layout(GTK_BUTTON_BOX(bbox), GTK_BUTTONBOX_END);
 
+	plugin_data->content_check = gtk_check_button_new_with_mnemonic(_("Search file _contents"));
+	gtk_container_add(GTK_CONTAINER(bbox), plugin_data->content_check);
+	gtk_button_box_set_child_secondary(GTK_BUTTON_BOX(bbox), plugin_data->content_check, TRUE);
+	g_signal_connect(plugin_data->content_check, "toggled", G_CALLBACK(on_content_toggled), plugin_data);
+
+	plugin_data->regex_check = gtk_check_button_new_with_mnemonic(_("_Regular expression"));
+	gtk_container_add(GTK_CONTAINER(bbox), plugin_data->regex_check);
+	gtk_button_box_set_child_secondary(GTK_BUTTON_BOX(bbox), plugin_data->regex_check, TRUE);
+	gtk_widget_set_sensitive(plugin_data->regex_check, FALSE);
+	g_signal_connect(plugin_data->regex_check, "toggled", G_CALLBACK(on_regex_toggled), plugin_data);
+
+	plugin_data->details_check = gtk_check_button_new_with_mnemonic(_("File _details"));
+	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(plugin_data->details_check), show_file_details);
+	gtk_container_add(GTK_CONTAINER(bbox), plugin_data->details_check);
+	gtk_button_box_set_child_secondary(GTK_BUTTON_BOX(bbox), plugin_data->details_check, TRUE);
+	g_signal_connect(plugin_data->details_check, "toggled", G_CALLBACK(on_details_toggled), plugin_data);
+
 	plugin_data->cancel_button = gtk_button_new_with_mnemonic(_("_Cancel"));
 	gtk_container_add(GTK_CONTAINER(bbox), plugin_data->cancel_button);
 	g_signal_connect(plugin_data->cancel_button, "clicked", G_CALLBACK(on_cancel_button), plugin_data);
@@ -523,10 +4934,159 @@ int launch_widget(void)
 	select_first_row(plugin_data);
 	on_update_visibilty_elements(plugin_data->main_window, plugin_data);
 
+	/* Show the index as it is right away and pick up changes made since
+	 * it was built in the background */
+	open_dialog = plugin_data;
+	update_location_status(plugin_data);
+	schedule_file_info(plugin_data);
+	index_rescan(RESCAN_REFRESH);
+
 	return 0;
 }
 
 
+/**********************************************************************/
+static gboolean on_index_updated(gpointer data)
+{
+	IndexScan *scan = data;
+	IndexUpdate *update = g_async_queue_try_pop(scan->updates);
+
+	D(log_debug("%s:%s", __FILE__, __FUNCTION__));
+
+	if(update == NULL)
+		return FALSE;
+
+	gboolean changed = update->index != NULL;
+	gchar *selected_file = NULL;
+	if(changed)
+	{
+		/* The ids in the file list refer to the index being replaced */
+		if(open_dialog != NULL)
+			selected_file = get_cursor_file(open_dialog);
+
+		/* Its file information is carried over when files are looked up */
+		if(file_index != NULL && file_index->infos != NULL)
+		{
+			file_index_free(file_info_source);
+			file_info_source = file_index;
+		}
+		else
+			file_index_free(file_index);
+		file_index = update->index;
+		file_index_generation++;
+		update->index = NULL;
+	}
+	if(update->statuses != NULL)
+	{
+		location_statuses_free(location_statuses);
+		location_statuses = update->statuses;
+		update->statuses = NULL;
+	}
+
+	if(update->last)
+	{
+		g_thread_join(index_thread);
+		index_thread = NULL;
+		index_scan = NULL;
+		file_index_saved = scan->cache_current;
+		if(scan->abandoned)
+			plugin_module_make_resident(geany_plugin);
+		index_scan_free(scan);
+
+		if(index_rescan_pending)
+		{
+			index_rescan_pending = FALSE;
+			index_rescan(RESCAN_FULL);
+		}
+	}
+	index_update_free(update);
+
+	if(open_dialog != NULL && changed)
+		set_file_model(open_dialog, selected_file);
+	g_free(selected_file);
+
+	if(open_dialog != NULL)
+	{
+		update_location_status(open_dialog);
+		if(!in_content_mode(open_dialog))
+			update_file_title(open_dialog);
+	}
+
+	return FALSE;
+}
+
+
+/**********************************************************************/
+/* Starts scanning the configured locations in the background */
+static void index_rescan(RescanMode mode)
+{
+	D(log_debug("%s:%s", __FILE__, __FUNCTION__));
+
+	if(index_thread != NULL)
+	{
+		/* The running scan may have been started with an old configuration */
+		if(mode == RESCAN_RESTART)
+		{
+			g_atomic_int_set(&index_scan->cancelled, TRUE);
+			g_async_queue_push(index_scan->finished, index_scan);
+		}
+		if(mode == RESCAN_RESTART || (mode == RESCAN_FULL && index_scan->refresh))
+			index_rescan_pending = TRUE;
+		return;
+	}
+
+	const gchar *readdir_delay = g_getenv(READDIR_DELAY_VARIABLE);
+
+	index_scan = g_malloc0(sizeof(IndexScan));
+	index_scan->locations = copy_locations(file_locations);
+	index_scan->previous = file_index;
+	index_scan->refresh = mode == RESCAN_REFRESH;
+	index_scan->readdir_delay = readdir_delay != NULL ? g_ascii_strtoull(readdir_delay, NULL, 10) * 1000 : 0;
+	index_scan->finished = g_async_queue_new();
+	index_scan->updates = g_async_queue_new();
+	index_scan->cache_file = g_build_filename(geany_plugin->geany_data->app->configdir, "plugins",
+	                                          PLUGIN_CONF_DIRECORY, INDEX_CACHE_FILE_NAME, NULL);
+	index_scan->cache_current = file_index_saved;
+
+	index_thread = g_thread_new("open-file-index", index_scan_thread, index_scan);
+}
+
+
+/**********************************************************************/
+static void index_stop(void)
+{
+	IndexUpdate *update;
+
+	if(index_thread == NULL)
+		return;
+
+	g_atomic_int_set(&index_scan->cancelled, TRUE);
+	g_async_queue_push(index_scan->finished, index_scan);
+	g_thread_join(index_thread);
+	index_thread = NULL;
+
+	/* Drop the updates that were published but not handled yet */
+	while(g_idle_remove_by_data(index_scan))
+		;
+	while((update = g_async_queue_try_pop(index_scan->updates)) != NULL)
+		index_update_free(update);
+
+	if(index_scan->abandoned)
+		plugin_module_make_resident(geany_plugin);
+	index_scan_free(index_scan);
+	index_scan = NULL;
+}
+
+
+/**********************************************************************/
+static void on_project_open(G_GNUC_UNUSED GObject *object, G_GNUC_UNUSED GKeyFile *config, G_GNUC_UNUSED gpointer data)
+{
+	D(log_debug("%s:%s", __FILE__, __FUNCTION__));
+
+	index_rescan(RESCAN_FULL);
+}
+
+
 /**********************************************************************/
 static void item_activate_cb(G_GNUC_UNUSED GtkMenuItem *menuitem, G_GNUC_UNUSED gpointer user_data)
 {
@@ -564,6 +5124,15 @@ static gboolean init(GeanyPlugin *plugin, G_GNUC_UNUSED gpointer pdata)
 	g_signal_connect(main_menu_item, "activate", G_CALLBACK(item_activate_cb), NULL);
 	geany_plugin_set_data(plugin, main_menu_item, NULL);
 
+	plugin_signal_connect(plugin, NULL, "project-open", TRUE, G_CALLBACK(on_project_open), NULL);
+
+	/* The file list model type cannot be registered again after a reload */
+	plugin_module_make_resident(plugin);
+
+	/* Build the index before the dialog is first opened */
+	update_file_locations();
+	index_rescan(RESCAN_FULL);
+
 	return TRUE;
 }
 
@@ -575,6 +5144,46 @@ static void cleanup(G_GNUC_UNUSED GeanyPlugin *plugin, gpointer pdata)
 
 	GtkWidget *main_menu_item = (GtkWidget*)pdata;
 	gtk_widget_destroy(main_menu_item);
+
+	index_stop();
+	file_index_free(file_index);
+	file_index = NULL;
+	file_index_free(file_info_source);
+	file_info_source = NULL;
+	location_statuses_free(location_statuses);
+	location_statuses = NULL;
+	query_cache_clear();
+	if(query_cache != NULL)
+	{
+		g_hash_table_destroy(query_cache);
+		query_cache = NULL;
+	}
+	clear_configuration(file_locations);
+	file_locations = NULL;
+
+	if(file_info_drain_id != 0)
+	{
+		g_source_remove(file_info_drain_id);
+		file_info_drain_id = 0;
+	}
+	if(file_info_results != NULL)
+	{
+		FileInfoTask *task;
+		while((task = g_async_queue_try_pop(file_info_results)) != NULL)
+			file_info_task_free(task);
+	}
+	file_info_tasks = 0;
+	g_atomic_int_inc(&plugin_load);
+
+	if(worker_pool != NULL)
+	{
+		/* Queued tasks are dropped and running ones are not waited for, a
+		 * worker may be blocked on a file system that stopped responding.
+		 * The code they run and the queue they push to are kept. */
+		g_thread_pool_free(worker_pool, TRUE, FALSE);
+		worker_pool = NULL;
+		plugin_module_make_resident(geany_plugin);
+	}
 }
 
 
@@ -884,6 +5493,9 @@ static void on_configure_response(G_GNUC_UNUSED GtkDialog* dialog, gint response
 		data = g_key_file_to_data(config, NULL, NULL);
 		utils_write_file(config_filename, data);
 		g_free(data);
+
+		if(update_file_locations())
+			index_rescan(RESCAN_RESTART);
 	}
 
 	for(i = 0; i < list_len; ++i)